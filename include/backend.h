@@ -0,0 +1,92 @@
+#ifndef BACKEND_H
+#define BACKEND_H
+
+#include "procs.h"
+
+#define MAX_OPERAND_NAME    (MAX_PROC_NAME + 8)
+
+enum OPERAND_KINDS
+{
+    OPERAND_CONSTANT,
+    OPERAND_VAR,
+    OPERAND_ELEMENT,        //name[constant] or name[var]
+    OPERAND_ARRAY           //every element of an array
+};
+
+enum OPERATIONS
+{
+    OPERATION_NONE,         //the first source is copied
+    OPERATION_ADD,
+    OPERATION_SUB,
+    OPERATION_MUL,
+    OPERATION_DIV
+};
+
+//A var, element or constant with its data memory addr already looked up
+struct operand
+{
+    enum OPERAND_KINDS kind;
+    int value;                          //constant
+    char name[MAX_OPERAND_NAME];        //var or array
+    int addr;                           //data addr, module relative with -c
+    int addend;                         //constant element index
+    int length;                         //element count of an array
+    char index_name[MAX_OPERAND_NAME];  //var index of an element, "" if constant
+    int index_addr;
+};
+
+struct backend_options
+{
+    int object_mode;        //-c, data and program addrs are relocations
+    long step_limit;        //passes before a -1 loop stops, if the target stops it
+};
+
+/*
+ * Everything main.c writes goes through one of these. Each backend picks
+ * its own instructions and registers, loads constants and addrs its own
+ * way and encodes the jumps for loops, ifs and procs.
+ */
+struct backend
+{
+    const char *name;
+    int program_addrs;      //addrs are known while compiling: line table, -c, profiles
+
+    void (*open)(const char *filename, struct backend_options *options);
+    void (*close)(void);
+    void (*code_begin)(int prog_memory_start);
+    int (*addr)(void);
+    void (*comment)(const char *text);
+
+    void (*declare_var)(struct operand *var, int value);
+    void (*assign)(struct operand *dest, struct operand *source);
+    void (*operate)(struct operand *dest, struct operand *source1,
+                    enum OPERATIONS operation, struct operand *source2);
+    void (*array_statement)(struct operand *dest, struct operand *source1,
+                            enum OPERATIONS operation, struct operand *source2,
+                            int unroll);
+
+    //counter is a data word for the count, none for a -1 loop
+    void (*loop_begin)(int amount, struct operand *counter);
+    void (*loop_end)(int line);         //line of the }
+    void (*if_begin)(struct operand *var, int value);
+    void (*if_end)(void);
+
+    //A cold if jumps away when equal, the body is written after program_end
+    int (*cold_if_begin)(struct operand *var, int value);
+    void (*program_end)(void);
+    void (*cold_body_begin)(int cold_if);
+    void (*cold_body_end)(int cold_if);
+
+    void (*proc_begin)(struct proc *proc, struct operand *return_slot);
+    void (*proc_end)(struct proc *proc, struct operand *return_slot);
+    void (*call)(struct proc *proc);
+
+    //Reports the final value of var when the program ends, may be NULL
+    void (*report_var)(struct operand *var);
+};
+
+extern struct backend samco_backend;
+extern struct backend x86_64_backend;
+extern struct backend bytecode_backend;
+
+#endif /* BACKEND_H */
@@ -0,0 +1,73 @@
+#ifndef BYTECODE_H
+#define BYTECODE_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define MAX_BYTECODE_NAME       64
+#define BYTECODE_TEMP_SLOTS     3
+
+enum BYTECODE_OPCODES
+{
+    BC_SET,             //slot dst = a
+    BC_MOVE,            //slot dst = slot a
+    BC_ADD,             //slot dst = slot a <op> slot b
+    BC_SUB,
+    BC_MUL,
+    BC_DIV,
+    BC_LOAD_ELEMENT,    //slot dst = slot (a + slot b) & 0xFFFF
+    BC_STORE_ELEMENT,   //slot (dst + slot b) & 0xFFFF = slot a
+    BC_ARRAY_MOVE,      //count slots from dst = slot a
+    BC_ARRAY_ADD,       //count slots from dst = slot a <op> slot b
+    BC_ARRAY_SUB,
+    BC_ARRAY_MUL,
+    BC_ARRAY_DIV,
+    BC_IF_NOT_EQUAL,    //go to target when slot a != b
+    BC_IF_EQUAL,        //go to target when slot a == b
+    BC_LOOP_BEGIN,      //slot dst = a, go to target when it is 0
+    BC_LOOP_END,        //go to target while --slot dst is not 0
+    BC_LOOP_FOREVER,    //go to target, stops at the step limit
+    BC_JUMP,
+    BC_CALL,
+    BC_RETURN,
+    BC_END,
+    BC_OPCODE_COUNT
+};
+
+struct bytecode_instruction
+{
+    const void *handler;    //set by interp_run for direct threaded dispatch
+    uint8_t opcode;
+    uint8_t a_step;         //array ops, 0 uses slot a for every element
+    uint8_t b_step;
+    int dst;
+    int a;
+    int b;
+    int count;
+    int target;             //instruction index
+    int line;               //.scc line of a -1 loop's }
+};
+
+struct bytecode_var
+{
+    char name[MAX_BYTECODE_NAME];
+    int slot;
+    int length;             //0 for a var, the element count for an array
+};
+
+struct bytecode_program
+{
+    struct bytecode_instruction *code;
+    int code_count;
+
+    struct bytecode_var *vars;
+    int var_count;
+
+    uint16_t *memory;       //data memory, then temps and constants
+    int slot_count;
+};
+
+void bytecode_take_program(struct bytecode_program *program);
+void bytecode_free(struct bytecode_program *program);
+
+#endif /* BYTECODE_H */
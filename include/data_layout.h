@@ -0,0 +1,25 @@
+#ifndef DATA_LAYOUT_H
+#define DATA_LAYOUT_H
+
+#include <stdio.h>
+
+#define MAX_LAYOUT_NAME     64
+
+struct layout_var
+{
+    char name[MAX_LAYOUT_NAME];
+    int length;             //1 for a var, the element count for an array
+    int order;              //declaration order
+    long weight;            //lines using it, or their profiled counts
+    long compares;          //ifs comparing it with a value below 256
+    int offset;             //from VAR_MEMORY_START, -1 until placed
+};
+
+void data_layout_scan(FILE *scc_fd);
+void data_layout_place(int start, int end, int addr_known);
+int data_layout_offset(const char *name);
+int data_layout_size();
+int data_layout_words();
+long data_layout_uses(const char *name);
+
+#endif /* DATA_LAYOUT_H */
@@ -1,6 +1,13 @@
 #ifndef ERRORS_H
 #define ERRORS_H
 
-void fatal_error(const char *format, ...);
+//Lets the compiler know code after a fatal_error is not reached
+#if defined(__GNUC__)
+#define ERRORS_NORETURN     __attribute__((noreturn))
+#else
+#define ERRORS_NORETURN
+#endif
+
+void fatal_error(const char *format, ...) ERRORS_NORETURN;
 
 #endif /* ERRORS_H */
@@ -0,0 +1,17 @@
+#ifndef INTERP_H
+#define INTERP_H
+
+#include "bytecode.h"
+
+#define DEFAULT_STEP_LIMIT      100000000L
+
+struct interp_result
+{
+    long steps;             //bytecode instructions run
+    int stopped_line;       //line of the -1 loop stopped by the step limit, 0 if none
+};
+
+void interp_run(struct bytecode_program *program, long step_limit,
+                struct interp_result *result);
+
+#endif /* INTERP_H */
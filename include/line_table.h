@@ -0,0 +1,24 @@
+#ifndef LINE_TABLE_H
+#define LINE_TABLE_H
+
+#include <stdio.h>
+
+enum LINE_CONSTRUCTS
+{
+    CONSTRUCT_NONE,
+    CONSTRUCT_VAR,
+    CONSTRUCT_ASSIGNMENT,
+    CONSTRUCT_IF,
+    CONSTRUCT_LOOP,
+    CONSTRUCT_PROC,
+    CONSTRUCT_CALL
+};
+
+void line_table_open(const char *table_filename, const char *source_filename);
+void line_table_add(int start_addr, int end_addr, int line,
+                    enum LINE_CONSTRUCTS construct);
+void line_table_close();
+
+const char *line_table_construct_name(enum LINE_CONSTRUCTS construct);
+
+#endif /* LINE_TABLE_H */
@@ -0,0 +1,19 @@
+#ifndef MACHINE_H
+#define MACHINE_H
+
+#define MAX_MACHINE_OPCODES     64
+#define MAX_OPCODE_NAME         16
+#define DEFAULT_MACHINE_FILE    "samco.mach"
+
+struct opcode_timing
+{
+    char name[MAX_OPCODE_NAME];
+    int latency;            //cycles until the result can be used
+    int load_use_penalty;   //extra cycles a dependent instruction waits
+};
+
+void machine_load(const char *filename, int required);
+int machine_issue_width();
+int machine_result_delay(const char *opcode);
+
+#endif /* MACHINE_H */
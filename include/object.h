@@ -0,0 +1,89 @@
+#ifndef OBJECT_H
+#define OBJECT_H
+
+#include <stdio.h>
+
+#define OBJECT_FORMAT_VERSION   2
+#define MAX_SYMBOL_NAME         64
+#define MAX_IMPORTS             64
+
+//Symbol name used by relocations against the module's own program memory
+#define OBJECT_PROG_SYMBOL      "."
+
+enum RELOCATION_BYTES
+{
+    RELOC_HI,
+    RELOC_LO
+};
+
+struct object_symbol
+{
+    char name[MAX_SYMBOL_NAME];
+    int offset;
+    int value;
+    int length;             //element count of an array, 0 for a var
+};
+
+struct object_extern
+{
+    char name[MAX_SYMBOL_NAME];
+    int length;             //element count of an array, 0 for a var
+};
+
+struct object_relocation
+{
+    int code_line;
+    enum RELOCATION_BYTES byte;
+    char symbol[MAX_SYMBOL_NAME];
+    int addend;
+};
+
+struct object_file
+{
+    char module[MAX_SYMBOL_NAME];
+    char source[MAX_SYMBOL_NAME];
+
+    int prog_memory_start;
+    int prog_memory_end;
+    int data_memory_start;
+    int data_memory_end;
+
+    int code_size;
+    int data_size;
+
+    char imports[MAX_IMPORTS][MAX_SYMBOL_NAME];
+    int import_count;
+
+    struct object_symbol *symbols;
+    int symbol_count;
+
+    struct object_extern *externs;
+    int extern_count;
+
+    char **code_lines;
+    int code_line_count;
+
+    struct object_relocation *relocations;
+    int relocation_count;
+
+    char **line_table;
+    int line_table_count;
+};
+
+void object_init(struct object_file *object);
+void object_free(struct object_file *object);
+
+void object_add_import(struct object_file *object, const char *module);
+void object_add_symbol(struct object_file *object, const char *name,
+                       int offset, int value, int length);
+void object_add_extern(struct object_file *object, const char *name,
+                       int length);
+void object_add_code_line(struct object_file *object, const char *line);
+void object_add_line_table_entry(struct object_file *object, const char *entry);
+
+void object_write(const char *filename, struct object_file *object);
+void object_read(const char *filename, struct object_file *object);
+
+void object_module_name(const char *filename, char *module);
+
+#endif /* OBJECT_H */
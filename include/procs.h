@@ -0,0 +1,41 @@
+#ifndef PROCS_H
+#define PROCS_H
+
+#include <stdio.h>
+
+#define MAX_PROCS                   256
+#define MAX_PROC_NAME               64
+#define DEFAULT_INLINE_THRESHOLD    16
+
+//Instructions the SAMCO calling convention costs, see README
+#define PROC_CALL_COST              6
+#define PROC_JUMP_OVER_COST         4
+#define PROC_LEAF_RETURN_COST       2
+#define PROC_SAVE_LINK_COST         3
+#define PROC_RESTORE_LINK_COST      5
+
+struct proc
+{
+    char name[MAX_PROC_NAME];
+    int first_line;         //line of 'proc name'
+    int last_line;          //line of the closing }
+
+    char **body;            //lines between the braces
+    int *body_line_index;
+    int body_count;
+
+    int call_sites;
+    int is_leaf;            //calls no other proc
+    int cost;               //estimated instructions in the body
+    int inlined;
+
+    int entry_addr;         //-1 until the body is written out of line
+};
+
+void procs_scan(FILE *scc_fd);
+struct proc *procs_find(const char *name);
+void procs_set_inlining(int enabled, int threshold);
+int procs_out_of_line_size(struct proc *proc);
+int procs_statement_cost(char *line);
+
+#endif /* PROCS_H */
@@ -0,0 +1,24 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdio.h>
+
+//Instructions one element of an unrolled array loop is estimated to take
+#define PROFILE_ARRAY_ELEMENT_COST  5
+//Array loop instructions that do not depend on the unroll
+#define PROFILE_ARRAY_LOOP_COST     20
+
+void profile_load(const char *filename);
+int profile_loaded();
+long profile_line_count(int line);
+
+void profile_scan(FILE *scc_fd);
+int profile_if_end_line(int if_line);
+int profile_if_body_is_cold(int if_line);
+int profile_array_unroll(int line);
+
+void profile_block_map_open(const char *map_filename, const char *source_filename);
+void profile_block_map_add(int addr, int line);
+void profile_block_map_close();
+
+#endif /* PROFILE_H */
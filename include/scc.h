@@ -4,6 +4,8 @@
 #define MAX_LINE_SIZE_CHAR      1024
 #define MAX_OPERATION_ARGS      5
 #define MAX_VARIABLES           1024
+#define MAX_NESTED_BLOCKS       32
+#define MAX_ARRAY_LOOP_UNROLL   4
 
 enum COMPILER_STATES
 {
@@ -13,16 +15,16 @@ enum COMPILER_STATES
     CLEANUP
 };
 
-char * scc16_filename; //default scc input filename
-char * samco_filename;//"main.samco"; //default samco output filename
+extern char * scc16_filename; //default scc input filename
+extern char * samco_filename;//"main.samco"; //default samco output filename
 
-int PROGRAM_MEMORY_START;
-int PROGRAM_MEMORY_END;
+extern int PROGRAM_MEMORY_START;
+extern int PROGRAM_MEMORY_END;
 
-int DATA_MEMORY_START; //By default variables start at the middle of data mem
-int DATA_MEMORY_END;
+extern int DATA_MEMORY_START; //By default variables start at the middle of data mem
+extern int DATA_MEMORY_END;
 
-int VAR_MEMORY_START;
-int VAR_MEMORY_INDEX;
+extern int VAR_MEMORY_START;
+extern int VAR_MEMORY_INDEX;
 
 #endif /* SCC_H */
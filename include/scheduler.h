@@ -0,0 +1,19 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#define MAX_INSTRUCTION_OPERANDS    2
+#define SCHEDULER_REGISTER_COUNT    8
+
+struct schedule_stats
+{
+    int instructions;
+    int regions;
+    int regions_reordered;
+    int stalls_before;      //estimated stall cycles as written
+    int stalls_after;       //estimated stall cycles once scheduled
+};
+
+void schedule_file(const char *samco_filename, int reorder,
+                   struct schedule_stats *stats);
+
+#endif /* SCHEDULER_H */
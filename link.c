@@ -0,0 +1,354 @@
+/*
+ * Program Name: SCC Linker
+ * Description: Links SCC object files (.sco) into one SCC ASM program
+ * Author: Samuel Cooper
+ *
+ * Compilation: run 'make'
+ *
+ * Notes:
+ *      Modules are placed in the order given on the command line. Code is
+ *      packed from PROG_MEMORY_START, vars are packed from the middle of
+ *      data memory the same way SCC places them for a single file.
+ *      <output>.vars lists every placed var in the .temp format so the
+ *      linked program's vars can be found.
+ *
+ * Style:
+ *  https://github.com/Samcooper01/StyleGuide/tree/main
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "./include/errors.h"
+#include "./include/scc.h"
+#include "./include/object.h"
+
+#define MAX_MODULES             256
+
+struct placed_symbol
+{
+    char name[MAX_SYMBOL_NAME];
+    int addr;
+    int value;
+    int length;             //element count of an array, 0 for a var
+    int module;
+};
+
+struct object_file modules[MAX_MODULES];
+int module_count = 0;
+int code_base[MAX_MODULES];
+int data_base[MAX_MODULES];
+
+struct placed_symbol *symbols;
+int symbol_count = 0;
+
+/**
+ * @brief Looks up a var as seen from module. Names starting with . are
+ *        local to the module that declares them.
+ *
+ */
+static struct placed_symbol *
+find_symbol(const char *name, int module)
+{
+    for(int i = 0; i < symbol_count; i++)
+    {
+        if(name[0] == '.' && symbols[i].module != module) continue;
+        if(strcmp(symbols[i].name, name) == 0) return &symbols[i];
+    }
+    return NULL;
+}
+
+/**
+ * @brief Checks every module was built for the same memory map and that
+ *        every import is one of the modules being linked
+ *
+ */
+static void
+check_modules()
+{
+    struct object_file *first = &modules[0];
+
+    for(int i = 0; i < module_count; i++)
+    {
+        struct object_file *module = &modules[i];
+        if(module->prog_memory_start != first->prog_memory_start
+           || module->prog_memory_end != first->prog_memory_end
+           || module->data_memory_start != first->data_memory_start
+           || module->data_memory_end != first->data_memory_end)
+        {
+            fatal_error("Module %s memory map does not match module %s\n",
+                        module->module, first->module);
+        }
+
+        for(int j = 0; j < i; j++)
+        {
+            if(strcmp(modules[j].module, module->module) == 0)
+            {
+                fatal_error("Module %s linked twice\n", module->module);
+            }
+        }
+
+        for(int j = 0; j < module->import_count; j++)
+        {
+            int found = 0;
+            for(int k = 0; k < module_count; k++)
+            {
+                if(strcmp(modules[k].module, module->imports[j]) == 0) found = 1;
+            }
+            if(!found)
+            {
+                fatal_error("Module %s imports %s which is not linked\n",
+                            module->module, module->imports[j]);
+            }
+        }
+    }
+}
+
+/**
+ * @brief Gives each module its code and data base and builds the global
+ *        symbol table
+ *
+ */
+static void
+place_modules()
+{
+    struct object_file *first = &modules[0];
+    int next_code = first->prog_memory_start;
+
+    //By default variables start at the middle of data memory
+    int next_data = (first->data_memory_end - first->data_memory_start) / 2
+                    + first->data_memory_start;
+
+    for(int i = 0; i < module_count; i++)
+    {
+        struct object_file *module = &modules[i];
+
+        code_base[i] = next_code;
+        data_base[i] = next_data;
+        next_code = next_code + module->code_size;
+        next_data = next_data + module->data_size;
+
+        for(int j = 0; j < module->symbol_count; j++)
+        {
+            struct object_symbol *symbol = &module->symbols[j];
+            struct placed_symbol *existing = find_symbol(symbol->name, i);
+            if(existing != NULL)
+            {
+                fatal_error("var %s declared in both %s and %s\n", symbol->name,
+                            modules[existing->module].module, module->module);
+            }
+
+            symbols = realloc(symbols, (symbol_count + 1) * sizeof(*symbols));
+            if(symbols == NULL) fatal_error("Out of memory\n");
+            strcpy(symbols[symbol_count].name, symbol->name);
+            symbols[symbol_count].addr = data_base[i] + symbol->offset;
+            symbols[symbol_count].value = symbol->value;
+            symbols[symbol_count].length = symbol->length;
+            symbols[symbol_count].module = i;
+            symbol_count++;
+        }
+    }
+
+    if(next_code - 1 > first->prog_memory_end)
+    {
+        fatal_error("Program needs %d instructions, PROG_MEMORY_END is %d\n",
+                    next_code - first->prog_memory_start,
+                    first->prog_memory_end);
+    }
+    if(next_data - 1 > first->data_memory_end)
+    {
+        fatal_error("Vars end at %d, DATA_MEMORY_END is %d\n",
+                    next_data - 1, first->data_memory_end);
+    }
+
+    for(int i = 0; i < module_count; i++)
+    {
+        for(int j = 0; j < modules[i].extern_count; j++)
+        {
+            struct object_extern *extern_var = &modules[i].externs[j];
+            struct placed_symbol *symbol = find_symbol(extern_var->name, i);
+            if(symbol == NULL)
+            {
+                fatal_error("extern var %s in %s is not declared by any module\n",
+                            extern_var->name, modules[i].module);
+            }
+            if(symbol->length != extern_var->length)
+            {
+                fatal_error("extern var %s in %s has length %d, %s declares it "
+                            "with length %d\n", extern_var->name,
+                            modules[i].module, extern_var->length,
+                            modules[symbol->module].module, symbol->length);
+            }
+        }
+    }
+}
+
+/**
+ * @brief Patches the relocations of one module into its code lines
+ *
+ */
+static void
+relocate_module(int module_index)
+{
+    struct object_file *module = &modules[module_index];
+
+    for(int i = 0; i < module->relocation_count; i++)
+    {
+        struct object_relocation *reloc = &module->relocations[i];
+        int addr;
+
+        if(strcmp(reloc->symbol, OBJECT_PROG_SYMBOL) == 0)
+        {
+            addr = code_base[module_index] + reloc->addend;
+        }
+        else
+        {
+            struct placed_symbol *symbol = find_symbol(reloc->symbol,
+                                                       module_index);
+            if(symbol == NULL)
+            {
+                fatal_error("Undefined var %s in %s\n", reloc->symbol,
+                            module->module);
+            }
+            addr = symbol->addr + reloc->addend;
+        }
+
+        int value = (reloc->byte == RELOC_HI) ? (addr >> 8) & 0xFF : addr & 0xFF;
+
+        //relocated bytes are always the last operand on the line
+        char *line = module->code_lines[reloc->code_line];
+        char *operand = strrchr(line, ' ');
+        if(operand == NULL || strcmp(operand, " 0x00") != 0)
+        {
+            fatal_error("Bad relocation target in %s: %s\n", module->module, line);
+        }
+        sprintf(operand, " 0x%02x", value);
+    }
+}
+
+static void
+write_program(char * samco_filename)
+{
+    FILE *samco_fd = fopen(samco_filename, "w");
+    if(samco_fd == NULL) fatal_error("SamCO output file failed to open\n");
+
+    for(int i = 0; i < module_count; i++)
+    {
+        for(int j = 0; j < modules[i].code_line_count; j++)
+        {
+            fprintf(samco_fd, "%s\n", modules[i].code_lines[j]);
+        }
+    }
+    fclose(samco_fd);
+}
+
+/**
+ * @brief Writes the linked line table, module entries moved to their base
+ *
+ */
+static void
+write_line_table(char * samco_filename)
+{
+    char line_table_filename[MAX_LINE_SIZE_CHAR];
+    char source[MAX_LINE_SIZE_CHAR];
+    char construct[MAX_LINE_SIZE_CHAR];
+    int start, end, line;
+
+    snprintf(line_table_filename, sizeof(line_table_filename), "%s.lines",
+             samco_filename);
+    FILE *line_table_fd = fopen(line_table_filename, "w");
+    if(line_table_fd == NULL) fatal_error("Failed to open %s\n", line_table_filename);
+
+    fprintf(line_table_fd, "//SCC line table\n");
+    fprintf(line_table_fd, "//start end source line construct\n");
+    for(int i = 0; i < module_count; i++)
+    {
+        for(int j = 0; j < modules[i].line_table_count; j++)
+        {
+            if(sscanf(modules[i].line_table[j], "%d %d %s %d %s", &start, &end,
+                      source, &line, construct) != 5)
+            {
+                fatal_error("Bad line table entry in %s\n", modules[i].module);
+            }
+            fprintf(line_table_fd, "%d %d %s %d %s\n", start + code_base[i],
+                                                       end + code_base[i],
+                                                       source, line, construct);
+        }
+    }
+    fclose(line_table_fd);
+}
+
+/**
+ * @brief Writes where every var was placed, one "addr name value [length]"
+ *        line each like SCC's .temp
+ *
+ */
+static void
+write_var_table(char * samco_filename)
+{
+    char var_table_filename[MAX_LINE_SIZE_CHAR];
+
+    snprintf(var_table_filename, sizeof(var_table_filename), "%s.vars",
+             samco_filename);
+    FILE *var_table_fd = fopen(var_table_filename, "w");
+    if(var_table_fd == NULL) fatal_error("Failed to open %s\n", var_table_filename);
+
+    for(int i = 0; i < symbol_count; i++)
+    {
+        if(symbols[i].length == 0)
+        {
+            fprintf(var_table_fd, "%d %s %d\n", symbols[i].addr, symbols[i].name,
+                                                symbols[i].value);
+        }
+        else
+        {
+            fprintf(var_table_fd, "%d %s %d %d\n", symbols[i].addr,
+                                                   symbols[i].name,
+                                                   symbols[i].value,
+                                                   symbols[i].length);
+        }
+    }
+    fclose(var_table_fd);
+}
+
+static void
+usage()
+{
+    printf("./SCC-link <output_name> <object_name> [<object_name> ...]\n");
+    printf("\n");
+    printf("<output_name>: Specifies output filepath\n");
+    printf("<object_name>: Object file made by './SCC -c'. Modules are placed\n");
+    printf("               in the order given\n");
+}
+
+int
+main(int argc, char **argv)
+{
+    if(argc == 2 && strcmp(argv[1], "usage") == 0)
+    {
+        usage();
+        exit(0);
+    }
+    if(argc < 3) fatal_error("./SCC-link usage\n");
+    if(argc - 2 > MAX_MODULES) fatal_error("Too many modules\n");
+
+    for(int i = 2; i < argc; i++)
+    {
+        object_read(argv[i], &modules[module_count++]);
+    }
+
+    check_modules();
+    place_modules();
+    for(int i = 0; i < module_count; i++) relocate_module(i);
+
+    write_program(argv[1]);
+    write_line_table(argv[1]);
+    write_var_table(argv[1]);
+
+    for(int i = 0; i < module_count; i++) object_free(&modules[i]);
+    free(symbols);
+    exit(0);
+}
+
+/* End of file: link.c */
@@ -16,23 +16,119 @@
 #include <string.h>
 #include <stdlib.h>
 #include <ctype.h>
+#include <stdarg.h>
+#include <time.h>
 
 #include "./include/errors.h"
 #include "./include/scc.h"
+#include "./include/line_table.h"
+#include "./include/object.h"
+#include "./include/procs.h"
+#include "./include/machine.h"
+#include "./include/scheduler.h"
+#include "./include/profile.h"
+#include "./include/data_layout.h"
+#include "./include/bytecode.h"
+#include "./include/interp.h"
+#include "./include/backend.h"
+
+char * scc16_filename;
+char * samco_filename;
+
+int PROGRAM_MEMORY_START;
+int PROGRAM_MEMORY_END;
+
+int DATA_MEMORY_START;
+int DATA_MEMORY_END;
+
+int VAR_MEMORY_START;
+int VAR_MEMORY_END;
+int VAR_MEMORY_INDEX;
 
 enum COMPILER_STATES current_state;
 
 FILE *scc_fd;
-FILE *samco_fd;
 
 int line_index = 1;
-int asm_instruction_addr;
 
-int loop_amount = 0;
-int loop_start_index = 0;
-int inside_an_infinite_loop = 0;
+//Writes the code, set by --target
+struct backend *backend = &samco_backend;
 
-int start_of_if_statement = 0;
+int if_depth = 0;
+
+//What each open { belongs to so } knows what to close
+enum BLOCK_KINDS
+{
+    BLOCK_LOOP,
+    BLOCK_PROC
+};
+enum BLOCK_KINDS block_stack[MAX_NESTED_BLOCKS];
+int block_depth = 0;
+
+struct proc *open_proc = NULL;
+int skip_until_line = 0;
+int inline_enabled = 1;
+int inline_threshold = DEFAULT_INLINE_THRESHOLD;
+
+char line_table_filename[MAX_LINE_SIZE_CHAR];
+
+int schedule_enabled = 1;
+int schedule_report = 0;
+int layout_report = 0;
+char * machine_filename = NULL;
+
+//Set by --profile-generate and --profile-use
+int profile_generate = 0;
+char * profile_filename = NULL;
+char block_map_filename[MAX_LINE_SIZE_CHAR];
+int block_leader_pending = 1;
+
+//if bodies the profile says are cold, written after the program
+struct cold_body
+{
+    int if_line;
+    int end_line;
+    int cold_if;            //from backend->cold_if_begin
+};
+struct cold_body *cold_bodies = NULL;
+int cold_body_count = 0;
+int cold_body_end_line = 0;
+
+//One .temp entry, see read_symbols
+struct symbol
+{
+    char name[MAX_OPERAND_NAME];
+    int addr;
+    int value;
+    int length;             //element count of an array, 0 for a var
+    int duplicate;          //an earlier entry has the same name
+};
+
+//Set by --run: run the program on the host instead of compiling it
+int run_mode = 0;
+long step_limit = DEFAULT_STEP_LIMIT;
+
+//Set by -c: compile one module to an object file for SCC-link
+int object_mode = 0;
+char * object_filename;
+char object_code_filename[MAX_LINE_SIZE_CHAR];
+struct object_file module_object;
+
+/**
+ * @brief Writes a comment line before the code of a statement
+ *
+ */
+static void
+write_comment(const char * format, ...)
+{
+    char buffer[MAX_LINE_SIZE_CHAR];
+    va_list args;
+
+    va_start(args, format);
+    vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    backend->comment(buffer);
+}
 
 static void
 open_scc_input_file()
@@ -67,7 +163,7 @@ parse_line_precode(char * line)
     if(strcmp(line, "\n") == 0) return;
 
     remove_newline(line);
-    char *column1 = strtok(line, " ");
+    strtok(line, " ");
 
     if(strcmp(line, "PROG_MEMORY_START") == 0)
     {
@@ -89,53 +185,38 @@ parse_line_precode(char * line)
         char *column2 = strtok(NULL, " ");
         DATA_MEMORY_END = atoi(column2);
     }
+    else if(strcmp(line, "import") == 0)
+    {
+        char *column2 = strtok(NULL, " ");
+        if(column2 == NULL) fatal_error("import needs a module name\n");
+        if(!object_mode)
+        {
+            fatal_error("import on line: %d needs separate compilation (-c)\n",
+                        line_index);
+        }
+        object_add_import(&module_object, column2);
+    }
     else if(strcmp(line, "CODE_BEGIN") == 0)
     {
         //By default variables start at the middle of data memory
         VAR_MEMORY_START = (DATA_MEMORY_END - DATA_MEMORY_START) / 2
                             + DATA_MEMORY_START;
-        VAR_MEMORY_INDEX = VAR_MEMORY_START;
-        current_state = CODE;
-    }
-
-}
-
-/**
- * @brief Saves a variable to the .temp file as well as writes asm to PUT
- *        the variable into memory at the addr stored in .temp file.
- *
- * @param line var keyword - strtok is set to this so next strtok will
- *                           return next string
- *
- */
-static void
-save_variable(char * line)
-{
-    FILE *var_list_fd = fopen(".temp", "a");
-    char *var_name = strtok(NULL, " ");
-    strtok(NULL, " ");
-    char *var_value = strtok(NULL, " ");
-
-    fprintf(var_list_fd, "%d %s %s\n", VAR_MEMORY_INDEX, var_name, var_value);
-    fclose(var_list_fd);
+        VAR_MEMORY_END = DATA_MEMORY_END;
 
-    VAR_MEMORY_INDEX++;
-
-    int var_value_int = atoi(var_value);
-
-    int upper_digits_value = (var_value_int >> 8) & 0xFF;
-    int lower_digits_value = (var_value_int & 0xFF);
-    fprintf(samco_fd, "//var %s = %s\n", line, var_value);
-    fprintf(samco_fd, "lshf DR 0x%02x\n", upper_digits_value);
-    fprintf(samco_fd, "lshf DR 0x%02x\n", lower_digits_value);
+        //Objects are module relative, SCC-link places them
+        if(object_mode)
+        {
+            VAR_MEMORY_END = DATA_MEMORY_END - VAR_MEMORY_START;
+            VAR_MEMORY_START = 0;
+        }
+        backend->code_begin(object_mode ? 0 : PROGRAM_MEMORY_START);
+        data_layout_place(VAR_MEMORY_START, VAR_MEMORY_END, !object_mode);
 
-    int upper_digits_addr = (VAR_MEMORY_INDEX >> 8) & 0xFF;
-    int lower_digits_addr = (VAR_MEMORY_INDEX & 0xFF);
-    fprintf(samco_fd, "lshf r7 0x%02x\n", upper_digits_addr);
-    fprintf(samco_fd, "lshf r7 0x%02x\n", lower_digits_addr);
-    fprintf(samco_fd, "PUT DR r7\n\n");
+        //Proc return slots go after the planned vars
+        VAR_MEMORY_INDEX = VAR_MEMORY_START + data_layout_size();
+        current_state = CODE;
+    }
 
-    asm_instruction_addr = asm_instruction_addr + 5;
 }
 
 /**
@@ -190,13 +271,64 @@ get_operand_addr(char * operand)
 }
 
 /**
- * @brief Returns value of variable
+ * @brief Checks the .temp file for a name
+ *
+ * @return 1 if operand has an entry, 0 if not
+ *
+ */
+static int
+symbol_exists(char * operand)
+{
+    char name_buffer[MAX_LINE_SIZE_CHAR];
+    int found = 0;
+
+    FILE *var_list_fd = fopen(".temp", "r");
+    if(var_list_fd == NULL) fatal_error("Failed to open var_list_fd\n");
+
+    while(!found && fgets(name_buffer, sizeof(name_buffer), var_list_fd) != NULL)
+    {
+        strtok(name_buffer, " ");
+        char *name_name = strtok(NULL, " \n");
+        if(name_name != NULL && strcmp(name_name, operand) == 0) found = 1;
+    }
+    fclose(var_list_fd);
+    return found;
+}
+
+/**
+ * @brief Splits an array element operand like buf[i] into name and index
+ *
+ * @return 1 if operand is an element, 0 if it is a plain name
+ *
+ */
+static int
+split_element(char * operand, char * name, char * index)
+{
+    char *open = strchr(operand, '[');
+    if(open == NULL) return 0;
+
+    char *close = strchr(open, ']');
+    if(close == NULL || close[1] != '\0' || close == open + 1)
+    {
+        fatal_error("Bad array element %s on line: %d\n", operand, line_index);
+    }
+    strncpy(name, operand, open - operand);
+    name[open - operand] = '\0';
+    strncpy(index, open + 1, close - open - 1);
+    index[close - open - 1] = '\0';
+    return 1;
+}
+
+/**
+ * @brief Returns the element count of an array from the .temp file
  *
  * @param operand name of variable to search for
  *
+ * @return element count, 0 if operand is not an array
+ *
  */
 static int
-get_operand_value(char * operand)
+get_operand_length(char * operand)
 {
     char name_buffer[MAX_LINE_SIZE_CHAR];
 
@@ -205,335 +337,622 @@ get_operand_value(char * operand)
 
     while(fgets(name_buffer, sizeof(name_buffer), var_list_fd) != NULL)
     {
-        char *name_addr = strtok(name_buffer, " ");
+        strtok(name_buffer, " ");
         char *name_name = strtok(NULL, " ");
-        char *name_value = strtok(NULL, " ");
+        strtok(NULL, " \n");
+        char *name_length = strtok(NULL, " \n");
         if(strcmp(name_name, operand) == 0)
         {
-            if(var_list_fd != NULL) fclose(var_list_fd);
-            return atoi(name_value);
+            fclose(var_list_fd);
+            return (name_length == NULL) ? 0 : atoi(name_length);
         }
     }
-    if(var_list_fd != NULL) fclose(var_list_fd);
+    fclose(var_list_fd);
     fatal_error("Couldnt find name for operand on line: %d\n", line_index);
 }
 
 /**
- * @brief Updates value of variable in .temp file
+ * @brief Copies a name into an operand, longer names than an operand
+ *        holds are an error
  *
- * @param name name to update
- * @param value value to replace with
+ */
+static void
+copy_operand_name(char *dest, const char *name)
+{
+    if(strlen(name) >= MAX_OPERAND_NAME)
+    {
+        fatal_error("Name %s is too long on line: %d\n", name, line_index);
+    }
+    strcpy(dest, name);
+}
+
+/**
+ * @brief Looks up a constant, var, name[constant], name[var] or whole
+ *        array for the backend
  *
  */
 static void
-update_saved_var(char * name, int value)
+resolve_operand(char * text, struct operand *operand)
 {
-    FILE *file;
-    FILE *tempFile;
-    char buffer[MAX_LINE_SIZE_CHAR];
-    // Open the original file for reading
-    file = fopen(".temp", "r");
-    if (file == NULL) {
-        perror("Error opening file");
+    char name[MAX_LINE_SIZE_CHAR];
+    char index[MAX_LINE_SIZE_CHAR];
+
+    memset(operand, 0, sizeof(*operand));
+    if(is_integer_string(text))
+    {
+        operand->kind = OPERAND_CONSTANT;
+        operand->value = atoi(text);
         return;
     }
 
-    // Create a temporary file for writing
-    tempFile = fopen("tempfile.tmp", "w");
-    if (tempFile == NULL) {
-        perror("Error creating temporary file");
-        fclose(file);
+    if(!split_element(text, name, index))
+    {
+        copy_operand_name(operand->name, text);
+        operand->addr = get_operand_addr(text);
+        operand->length = get_operand_length(text);
+        operand->kind = (operand->length == 0) ? OPERAND_VAR : OPERAND_ARRAY;
         return;
     }
 
-    // Read the original file line by line
-    while (fgets(buffer, sizeof(buffer), file)) {
-       // printf("%s\n", buffer);
-        char *buffer_copy = (char *)malloc(sizeof(buffer));
-        strcpy(buffer_copy, buffer);
-        char* line_addr = strtok(buffer_copy, " ");
-        char* line_name = strtok(NULL, " ");
+    int length = get_operand_length(name);
+    if(length == 0) fatal_error("%s is not an array on line: %d\n", name, line_index);
+    operand->kind = OPERAND_ELEMENT;
+    copy_operand_name(operand->name, name);
+    operand->addr = get_operand_addr(name);
+    operand->length = length;
 
-        if (strcmp(line_name, name) == 0)
+    if(is_integer_string(index))
+    {
+        int element = atoi(index);
+        if(element < 0 || element >= length)
         {
-            char str[20];
-            sprintf(str, "%d", value);
-
-            int new_length = strlen(line_addr) + strlen(line_name) + strlen(str);
-            char *new_line = (char *)malloc(new_length + 3);
-            new_line[0] = '\0';
-            strcat(new_line, line_addr);
-            strcat(new_line, " ");
-            strcat(new_line, line_name);
-            strcat(new_line, " ");
-            strcat(new_line, str);
-
-            fprintf(tempFile, "%s\n", new_line);
-        } else {
-            // Write the existing line to the temporary file
-            fprintf(tempFile, "%s", buffer);
+            fatal_error("Index %d out of bounds for %s[%d] on line: %d\n",
+                        element, name, length, line_index);
         }
-        free(buffer_copy);
+        operand->addend = element;
+        return;
     }
 
-    // Close both files
-    fclose(file);
-    fclose(tempFile);
-    // Replace the original file with the temporary file
-    if (remove(".temp") != 0) fatal_error("Couldn't remove .temp file\n");
-    if (rename("tempfile.tmp", ".temp") != 0)
+    //A var index is read when the program runs
+    if(get_operand_length(index) != 0)
     {
-        fatal_error("Couldn't remove tempfile.tmp\n");
+        fatal_error("Array %s needs an index on line: %d\n", index, line_index);
     }
-
+    copy_operand_name(operand->index_name, index);
+    operand->index_addr = get_operand_addr(index);
 }
 
 /**
- * @brief Write ASM assignment operation with variable addr and value
+ * @brief resolve_operand for a single value, a whole array is an error
  *
  */
 static void
-write_assignment_operation(char * operations_args[], char * source)
+resolve_value_operand(char * text, struct operand *operand)
 {
-    int operand_values[2];
-    int int_check = is_integer_string(operations_args[2]);
-    if(int_check)
+    resolve_operand(text, operand);
+    if(operand->kind == OPERAND_ARRAY)
     {
-        operand_values[0] = atoi(operations_args[2]);
-        int source_addr = get_operand_addr(source);
-
-        int upper_digits_value_o1 = (operand_values[0] >> 8) & 0xFF;
-        int lower_digits_value_01 = (operand_values[0] & 0xFF);
-
-        fprintf(samco_fd, "lshf DR 0x%02x\n", upper_digits_value_o1);
-        fprintf(samco_fd, "lshf DR 0x%02x\n", lower_digits_value_01);
-
-        int upper_digits_source = source_addr / 100;
-        int lower_digits_source = source_addr % 100;
-
-        fprintf(samco_fd, "lshf r6 0x%02d\n", upper_digits_source);
-        fprintf(samco_fd, "lshf r6 0x%02d\n", lower_digits_source);
-
-        fprintf(samco_fd, "put DR r6\n");
-        asm_instruction_addr = asm_instruction_addr + 5;
-        update_saved_var(operations_args[0], operand_values[0]);
+        fatal_error("Array %s needs an index on line: %d\n", text, line_index);
     }
-    else
-    {
-        operand_values[0] = get_operand_addr(operations_args[2]);
-        int source_addr = get_operand_addr(source);
-
-        int upper_digits_dest = operand_values[0] / 100;
-        int lower_digits_dest = operand_values[0] % 100;
-
-        fprintf(samco_fd, "lshf DR 0x%02d\n", upper_digits_dest);
-        fprintf(samco_fd, "lshf DR 0x%02d\n", lower_digits_dest);
-        fprintf(samco_fd, "get r6 DR\n");
-
-        int upper_digits_source = source_addr / 100;
-        int lower_digits_source = source_addr % 100;
-
-        fprintf(samco_fd, "lshf r5 0x%02d\n", upper_digits_source);
-        fprintf(samco_fd, "lshf r5 0x%02d\n", lower_digits_source);
+}
+/**
+ * @brief Returns 1 if operand is a whole array. Arrays used together must
+ *        be the same length.
+ *
+ */
+static int
+is_array_operand(char * operand, int length)
+{
+    if(is_integer_string(operand) || strchr(operand, '[') != NULL) return 0;
 
-        fprintf(samco_fd, "put r6 r5");
-        asm_instruction_addr = asm_instruction_addr + 6;
+    int operand_length = get_operand_length(operand);
+    if(operand_length == 0) return 0;
+    if(operand_length != length)
+    {
+        fatal_error("Array %s has %d elements, expected %d on line: %d\n",
+                    operand, operand_length, length, line_index);
     }
+    return 1;
+}
 
+static enum OPERATIONS
+operation_of(char * operator)
+{
+    if(strcmp(operator, "+") == 0) return OPERATION_ADD;
+    if(strcmp(operator, "-") == 0) return OPERATION_SUB;
+    if(strcmp(operator, "*") == 0) return OPERATION_MUL;
+    if(strcmp(operator, "/") == 0) return OPERATION_DIV;
+    fatal_error("Operation not recognized on line: %d\n", line_index);
 }
 
 /**
- * @brief writes asm equivalent of operation which is one of + - / *
+ * @brief dest[i] = source1[i] <operator> source2[i] for every element of
+ *        dest, or dest[i] = source1[i] when operator is NULL. A source that
+ *        is not an array is used for every element. With a profile the
+ *        backend may handle fewer elements per pass.
  *
  */
 static void
-perform_operation(char * line)
+write_array_statement(char * dest, char * source1, char * operator, char * source2)
 {
-    char *operations_args[MAX_OPERATION_ARGS];
-    operations_args[0] = line;
-
-    char *arg1 = strtok(NULL, " ");
-    operations_args[1] = arg1;
-    char *arg2 = strtok(NULL, " ");
-    operations_args[2] = arg2;
-    char *arg3 = strtok(NULL, " ");
-    operations_args[3] = arg3;
-    char *arg4 = strtok(NULL, " ");
-    operations_args[4] = arg4;
-
-    if(strcmp(operations_args[1], "=") != 0)
-    {
-        fatal_error("Instruction on line: %d is not valid\n", line_index);
-    }
+    struct operand operands[3];
+    enum OPERATIONS operation = OPERATION_NONE;
+    int source_count = 1;
 
-    if(operations_args[3] != NULL || operations_args[4] != NULL)
+    resolve_operand(dest, &operands[0]);
+    resolve_operand(source1, &operands[1]);
+    if(operator != NULL)
     {
-        fprintf(samco_fd, "\n//%s %s %s %s %s\n", operations_args[0],
-                                                operations_args[1],
-                                                operations_args[2],
-                                                operations_args[3],
-                                                operations_args[4]);
+        operation = operation_of(operator);
+        resolve_operand(source2, &operands[2]);
+        source_count = 2;
     }
-    else
+    for(int i = 1; i <= source_count; i++)
     {
-        fprintf(samco_fd, "\n//%s %s %s\n", operations_args[0],
-                                            operations_args[1],
-                                            operations_args[2]);
+        if(operands[i].kind == OPERAND_ARRAY && operands[i].length != operands[0].length)
+        {
+            fatal_error("Array %s has %d elements, expected %d on line: %d\n",
+                        operands[i].name, operands[i].length, operands[0].length,
+                        line_index);
+        }
     }
-    //Get operands
-    int operand_values[2];
 
-    if(NULL == operations_args[2])
+    backend->array_statement(&operands[0], &operands[1], operation, &operands[2],
+                             profile_array_unroll(line_index));
+}
+/**
+ * @brief fill <array> <value>: sets every element to a constant or var
+ *
+ */
+static void
+fill_array(char * line)
+{
+    (void)line;
+    char *array_name = strtok(NULL, " ");
+    char *value = strtok(NULL, " ");
+    if(array_name == NULL || value == NULL)
     {
-        fatal_error("Instruction on line: %d is not valid\n", line_index);
+        fatal_error("Expected 'fill <array> <value>' on line: %d\n", line_index);
     }
-    else if (NULL == operations_args[3])
+    if(get_operand_length(array_name) == 0)
     {
-        write_assignment_operation(operations_args, line);
-        return;
+        fatal_error("%s is not an array on line: %d\n", array_name, line_index);
     }
-
-    if(NULL == operations_args[2] || NULL == operations_args[4]
-        || NULL == operations_args[3])
+    if(!is_integer_string(value) && strchr(value, '[') == NULL
+       && get_operand_length(value) != 0)
     {
-        fatal_error("Instruction on line: %d is not valid\n", line_index);
+        fatal_error("fill needs a single value on line: %d, use copy\n", line_index);
     }
-    else
-    {
-        int int_check0 = is_integer_string(operations_args[2]);
-        if(int_check0)
-        {
-            operand_values[0] = atoi(operations_args[2]);
-
-            int upper_digits_operand0 = (operand_values[0] >> 8) & 0xFF;
-            int lower_digits_operand0 = operand_values[0] & 0xFF;
-
-            fprintf(samco_fd, "lshf r6 0x%02x\n", upper_digits_operand0);
-            fprintf(samco_fd, "lshf r6 0x%02x\n", lower_digits_operand0);
-            asm_instruction_addr = asm_instruction_addr + 2;
-        }
-        else
-        {
-            int operand0_addr = get_operand_addr(operations_args[2]);
-            operand_values[0] = get_operand_value(operations_args[2]);
-
-            int upper_digits_operand0_addr = operand0_addr / 100;
-            int lower_digits_operand0_addr = operand0_addr % 100;
-
-            fprintf(samco_fd, "lshf DR 0x%02d\n", upper_digits_operand0_addr);
-            fprintf(samco_fd, "lshf DR 0x%02d\n", lower_digits_operand0_addr);
-            fprintf(samco_fd, "GET r6 DR\n");
-            asm_instruction_addr = asm_instruction_addr + 3;
-        }
-
-        int int_check1 = is_integer_string(operations_args[4]);
-        if(int_check1)
-        {
-            operand_values[1] = atoi(operations_args[4]);
-
-            int upper_digits_operand1 = (operand_values[1] >> 8) & 0xFF;
-            int lower_digits_operand1 = operand_values[1] & 0xFF;
-
-            fprintf(samco_fd, "lshf r5 0x%02x\n", upper_digits_operand1);
-            fprintf(samco_fd, "lshf r5 0x%02x\n", lower_digits_operand1);
-            asm_instruction_addr = asm_instruction_addr + 2;
-        }
-        else
-        {
-            int operand1_addr = get_operand_addr(operations_args[4]);
-            operand_values[1] = get_operand_value(operations_args[4]);
-
-            int upper_digits_operand1_addr = operand1_addr / 100;
-            int lower_digits_operand1_addr = operand1_addr % 100;
-
-            fprintf(samco_fd, "lshf DR 0x%02d\n", upper_digits_operand1_addr);
-            fprintf(samco_fd, "lshf DR 0x%02d\n", lower_digits_operand1_addr);
-            fprintf(samco_fd, "GET r5 DR\n");
-            asm_instruction_addr = asm_instruction_addr + 3;
-        }
-
-        int result_addr = get_operand_addr(line);
-
-        int upper_digits_result_addr = result_addr / 100;
-        int lower_digits_result_addr = result_addr % 100;
-
-        fprintf(samco_fd, "lshf r3 0x%02d\n", upper_digits_result_addr);
-        fprintf(samco_fd, "lshf r3 0x%02d\n", lower_digits_result_addr);
-        asm_instruction_addr = asm_instruction_addr + 2;
 
-
-        // r4 = r5 <operation> r6
-        if(strcmp("+", operations_args[3]) == 0)
-        {
-            fprintf(samco_fd, "add r6 r5\n");
-            fprintf(samco_fd, "lshf r4 0x00\n");
-            fprintf(samco_fd, "lshf r4 0x00\n");
-            fprintf(samco_fd, "add r4, r6\n");
-            fprintf(samco_fd, "PUT r4, r3\n");
-            asm_instruction_addr = asm_instruction_addr + 5;
-            update_saved_var(line, (operand_values[0] + operand_values[1]));
-        }
-        else if(strcmp("-", operations_args[3]) == 0)
-        {
-            fprintf(samco_fd, "sub r6 r5\n");
-            fprintf(samco_fd, "lshf r4 0x00\n");
-            fprintf(samco_fd, "lshf r4 0x00\n");
-            fprintf(samco_fd, "add r4, r5\n");
-            fprintf(samco_fd, "PUT r4, r3\n");
-            asm_instruction_addr = asm_instruction_addr + 5;
-            if(operand_values[1] > operand_values[0]) update_saved_var(line, 0);
-            else update_saved_var(line, (operand_values[0] - operand_values[1]));
-        }
-        else if(strcmp("*", operations_args[3]) == 0)
-        {
-            fprintf(samco_fd, "mul r6 r5\n");
-            fprintf(samco_fd, "lshf r4 0x00\n");
-            fprintf(samco_fd, "lshf r4 0x00\n");
-            fprintf(samco_fd, "add r4, r5\n");
-            fprintf(samco_fd, "PUT r4, r3\n");
-            asm_instruction_addr = asm_instruction_addr + 5;
-            update_saved_var(line, (operand_values[0] * operand_values[1]));
-        }
-        else if(strcmp("/", operations_args[3]) == 0)
-        {
-            fprintf(samco_fd, "div r6 r5\n");
-            fprintf(samco_fd, "lshf r4 0x00\n");
-            fprintf(samco_fd, "lshf r4 0x00\n");
-            fprintf(samco_fd, "add r4, r5\n");
-            fprintf(samco_fd, "PUT r4, r3\n");
-            asm_instruction_addr = asm_instruction_addr + 5;
-            if(operand_values[1] == 0) update_saved_var(line, 0);
-            else update_saved_var(line, (operand_values[0] / operand_values[1]));
-        }
-        else
-        {
-            fatal_error("Operation not recognized on line: %d\n", line);
-        }
-    }
+    write_comment("fill %s %s", array_name, value);
+    write_array_statement(array_name, value, NULL, NULL);
 }
 
 /**
- * @brief Setup loop count and index
+ * @brief copy <dest array> <source array>
  *
  */
 static void
-entering_loop(char * line)
+copy_array(char * line)
 {
-    loop_amount = atoi(strtok(NULL, " "));
-    if(loop_amount == -1) inside_an_infinite_loop = 1;
-    fprintf(samco_fd, "\n//Loop begins\n");
-    fprintf(samco_fd, "lshf r1 0x%02x\n", (loop_amount >> 8) & 0xFF);
-    fprintf(samco_fd, "lshf r1 0x%02x\n", loop_amount & 0xFF);
-    fprintf(samco_fd, "lshf r2 0x00\n");
-    fprintf(samco_fd, "lshf r2 0x00\n");
-    asm_instruction_addr = asm_instruction_addr + 4;
+    (void)line;
+    char *dest_name = strtok(NULL, " ");
+    char *source_name = strtok(NULL, " ");
+    if(dest_name == NULL || source_name == NULL)
+    {
+        fatal_error("Expected 'copy <array> <array>' on line: %d\n", line_index);
+    }
+    int length = get_operand_length(dest_name);
+    if(length == 0 || !is_array_operand(source_name, length))
+    {
+        fatal_error("copy needs two arrays on line: %d\n", line_index);
+    }
 
-    loop_start_index = asm_instruction_addr + 2;
-    fprintf(samco_fd, "lshf r3 0x%02x\n", (loop_start_index >> 8) & 0xFF);
-    fprintf(samco_fd, "lshf r3 0x%02x\n", loop_start_index & 0xFF);
-    asm_instruction_addr = asm_instruction_addr + 2;
+    write_comment("copy %s %s", dest_name, source_name);
+    write_array_statement(dest_name, source_name, NULL, NULL);
 }
 
+/**
+ * @brief Data memory addr for a new var, from the data layout plan if it
+ *        has one
+ *
+ * @param length words the var takes
+ *
+ */
+static int
+allocate_var(char * name, int length)
+{
+    int offset = data_layout_offset(name);
+    if(offset >= 0) return VAR_MEMORY_START + offset;
+
+    int addr = VAR_MEMORY_INDEX;
+    VAR_MEMORY_INDEX = VAR_MEMORY_INDEX + length;
+    if(!object_mode && VAR_MEMORY_INDEX - 1 > DATA_MEMORY_END)
+    {
+        fatal_error("No room for var %s in data memory, DATA_MEMORY_END is %d\n",
+                    name, DATA_MEMORY_END);
+    }
+    return addr;
+}
+
+/**
+ * @brief Saves an array to the .temp file with its element count and
+ *        fills it with the initial value if there is one
+ *
+ * @param declaration name[size]
+ * @param var_value initial value of every element, may be NULL
+ *
+ */
+static void
+save_array(char * declaration, char * var_value)
+{
+    char name[MAX_LINE_SIZE_CHAR];
+    char size[MAX_LINE_SIZE_CHAR];
+    split_element(declaration, name, size);
+
+    int length = atoi(size);
+    if(!is_integer_string(size) || length < 1)
+    {
+        fatal_error("Array size must be a positive number on line: %d\n", line_index);
+    }
+
+    FILE *var_list_fd = fopen(".temp", "a");
+    fprintf(var_list_fd, "%d %s 0 %d\n", allocate_var(name, length), name, length);
+    fclose(var_list_fd);
+
+    if(var_value == NULL) return;
+    write_comment("var %s = %s", declaration, var_value);
+    write_array_statement(name, var_value, NULL, NULL);
+}
+
+/**
+ * @brief Saves a variable to the .temp file as well as writes asm to PUT
+ *        the variable into memory at the addr stored in .temp file.
+ *
+ * @param line var keyword - strtok is set to this so next strtok will
+ *                           return next string
+ *
+ */
+static void
+save_variable(char * line)
+{
+    (void)line;
+    char *var_name = strtok(NULL, " ");
+    strtok(NULL, " ");
+    char *var_value = strtok(NULL, " ");
+
+    if(strchr(var_name, '[') != NULL)
+    {
+        save_array(var_name, var_value);
+        return;
+    }
+
+    FILE *var_list_fd = fopen(".temp", "a");
+
+    fprintf(var_list_fd, "%d %s %s\n", allocate_var(var_name, 1), var_name, var_value);
+    fclose(var_list_fd);
+
+    struct operand var;
+    resolve_operand(var_name, &var);
+    write_comment("var %s = %s", var_name, var_value);
+    backend->declare_var(&var, atoi(var_value));
+}
+
+/**
+ * @brief Saves an extern var to the .temp file. It has no storage in this
+ *        module, SCC-link resolves it against the module that declares it.
+ *
+ * @param line extern keyword - strtok is set to this
+ *
+ */
+static void
+save_extern_variable(char * line)
+{
+    (void)line;
+    char *var_keyword = strtok(NULL, " ");
+    char *var_name = strtok(NULL, " ");
+    if(var_keyword == NULL || strcmp(var_keyword, "var") != 0 || var_name == NULL)
+    {
+        fatal_error("Expected 'extern var <name>' on line: %d\n", line_index);
+    }
+    if(!object_mode)
+    {
+        fatal_error("extern var on line: %d needs separate compilation (-c)\n",
+                    line_index);
+    }
+
+    char name[MAX_LINE_SIZE_CHAR];
+    char size[MAX_LINE_SIZE_CHAR];
+    int length = 0;
+    FILE *var_list_fd = fopen(".temp", "a");
+    if(split_element(var_name, name, size))
+    {
+        length = atoi(size);
+        fprintf(var_list_fd, "-1 %s 0 %d\n", name, length);
+        var_name = name;
+    }
+    else fprintf(var_list_fd, "-1 %s 0\n", var_name);
+    fclose(var_list_fd);
+    object_add_extern(&module_object, var_name, length);
+}
+
+/**
+ * @brief Returns value of variable
+ *
+ * @param operand name of variable to search for
+ *
+ */
+static int
+get_operand_value(char * operand)
+{
+    char name_buffer[MAX_LINE_SIZE_CHAR];
+
+    //Element values are not tracked
+    if(strchr(operand, '[') != NULL) return 0;
+
+    FILE *var_list_fd = fopen(".temp", "r");
+    if(var_list_fd == NULL) fatal_error("Failed to open var_list_fd\n");
+
+    while(fgets(name_buffer, sizeof(name_buffer), var_list_fd) != NULL)
+    {
+        strtok(name_buffer, " ");
+        char *name_name = strtok(NULL, " ");
+        char *name_value = strtok(NULL, " ");
+        if(strcmp(name_name, operand) == 0)
+        {
+            if(var_list_fd != NULL) fclose(var_list_fd);
+            return atoi(name_value);
+        }
+    }
+    if(var_list_fd != NULL) fclose(var_list_fd);
+    fatal_error("Couldnt find name for operand on line: %d\n", line_index);
+}
+
+/**
+ * @brief Updates value of variable in .temp file
+ *
+ * @param name name to update
+ * @param value value to replace with
+ *
+ */
+static void
+update_saved_var(char * name, int value)
+{
+    FILE *file;
+    FILE *tempFile;
+    char buffer[MAX_LINE_SIZE_CHAR];
+    // Open the original file for reading
+    file = fopen(".temp", "r");
+    if (file == NULL) {
+        perror("Error opening file");
+        return;
+    }
+
+    // Create a temporary file for writing
+    tempFile = fopen("tempfile.tmp", "w");
+    if (tempFile == NULL) {
+        perror("Error creating temporary file");
+        fclose(file);
+        return;
+    }
+
+    // Read the original file line by line
+    while (fgets(buffer, sizeof(buffer), file)) {
+       // printf("%s\n", buffer);
+        char *buffer_copy = (char *)malloc(sizeof(buffer));
+        strcpy(buffer_copy, buffer);
+        char* line_addr = strtok(buffer_copy, " ");
+        char* line_name = strtok(NULL, " ");
+
+        if (strcmp(line_name, name) == 0)
+        {
+            char str[20];
+            sprintf(str, "%d", value);
+
+            int new_length = strlen(line_addr) + strlen(line_name) + strlen(str);
+            char *new_line = (char *)malloc(new_length + 3);
+            new_line[0] = '\0';
+            strcat(new_line, line_addr);
+            strcat(new_line, " ");
+            strcat(new_line, line_name);
+            strcat(new_line, " ");
+            strcat(new_line, str);
+
+            fprintf(tempFile, "%s\n", new_line);
+        } else {
+            // Write the existing line to the temporary file
+            fprintf(tempFile, "%s", buffer);
+        }
+        free(buffer_copy);
+    }
+
+    // Close both files
+    fclose(file);
+    fclose(tempFile);
+    // Replace the original file with the temporary file
+    if (remove(".temp") != 0) fatal_error("Couldn't remove .temp file\n");
+    if (rename("tempfile.tmp", ".temp") != 0)
+    {
+        fatal_error("Couldn't remove tempfile.tmp\n");
+    }
+
+}
+
+/**
+ * @brief Write assignment of a constant, var or element to source
+ *
+ */
+static void
+write_assignment_operation(char * operations_args[], char * source)
+{
+    struct operand dest;
+    struct operand value;
+    resolve_value_operand(operations_args[2], &value);
+    resolve_value_operand(source, &dest);
+
+    backend->assign(&dest, &value);
+    if(value.kind == OPERAND_CONSTANT)
+    {
+        update_saved_var(operations_args[0], value.value);
+    }
+}
+/**
+ * @brief writes asm equivalent of operation which is one of + - / *
+ *
+ */
+static void
+perform_operation(char * line)
+{
+    char *operations_args[MAX_OPERATION_ARGS];
+    operations_args[0] = line;
+
+    char *arg1 = strtok(NULL, " ");
+    operations_args[1] = arg1;
+    char *arg2 = strtok(NULL, " ");
+    operations_args[2] = arg2;
+    char *arg3 = strtok(NULL, " ");
+    operations_args[3] = arg3;
+    char *arg4 = strtok(NULL, " ");
+    operations_args[4] = arg4;
+
+    if(strcmp(operations_args[1], "=") != 0)
+    {
+        fatal_error("Instruction on line: %d is not valid\n", line_index);
+    }
+
+    if(operations_args[3] != NULL || operations_args[4] != NULL)
+    {
+        write_comment("%s %s %s %s %s", operations_args[0], operations_args[1],
+                      operations_args[2], operations_args[3], operations_args[4]);
+    }
+    else
+    {
+        write_comment("%s %s %s", operations_args[0], operations_args[1],
+                      operations_args[2]);
+    }
+    //Get operands
+    int operand_values[2];
+
+    if(NULL == operations_args[2])
+    {
+        fatal_error("Instruction on line: %d is not valid\n", line_index);
+    }
+    else if(strchr(line, '[') == NULL && get_operand_length(line) != 0)
+    {
+        //Whole array, every element gets the operation
+        if(NULL != operations_args[3] && NULL == operations_args[4])
+        {
+            fatal_error("Instruction on line: %d is not valid\n", line_index);
+        }
+        write_array_statement(line, operations_args[2], operations_args[3],
+                              operations_args[4]);
+        return;
+    }
+    else if (NULL == operations_args[3])
+    {
+        write_assignment_operation(operations_args, line);
+        return;
+    }
+
+    if(NULL == operations_args[2] || NULL == operations_args[4]
+        || NULL == operations_args[3])
+    {
+        fatal_error("Instruction on line: %d is not valid\n", line_index);
+    }
+    else
+    {
+        struct operand sources[2];
+        struct operand dest;
+        resolve_value_operand(operations_args[2], &sources[0]);
+        resolve_value_operand(operations_args[4], &sources[1]);
+        resolve_value_operand(line, &dest);
+        enum OPERATIONS operation = operation_of(operations_args[3]);
+
+        for(int i = 0; i < 2; i++)
+        {
+            if(sources[i].kind == OPERAND_CONSTANT) operand_values[i] = sources[i].value;
+            else operand_values[i] = get_operand_value(operations_args[2 + 2 * i]);
+        }
+
+        backend->operate(&dest, &sources[0], operation, &sources[1]);
+
+        if(operation == OPERATION_ADD)
+        {
+            update_saved_var(line, (operand_values[0] + operand_values[1]));
+        }
+        else if(operation == OPERATION_SUB)
+        {
+            if(operand_values[1] > operand_values[0]) update_saved_var(line, 0);
+            else update_saved_var(line, (operand_values[0] - operand_values[1]));
+        }
+        else if(operation == OPERATION_MUL)
+        {
+            update_saved_var(line, (operand_values[0] * operand_values[1]));
+        }
+        else
+        {
+            if(operand_values[1] == 0) update_saved_var(line, 0);
+            else update_saved_var(line, (operand_values[0] / operand_values[1]));
+        }
+    }
+}
+
+static void
+push_block(enum BLOCK_KINDS kind)
+{
+    if(block_depth >= MAX_NESTED_BLOCKS)
+    {
+        fatal_error("Blocks nested too deep on line: %d\n", line_index);
+    }
+    block_stack[block_depth++] = kind;
+}
+
+/**
+ * @brief Adds a data word the compiler uses itself to .temp, after the
+ *        planned vars. The leading . keeps it local to the module.
+ *
+ */
+static void
+allocate_slot(char *slot_name, struct operand *slot)
+{
+    if(!object_mode && VAR_MEMORY_INDEX > DATA_MEMORY_END)
+    {
+        fatal_error("No room for %s in data memory, DATA_MEMORY_END is %d\n",
+                    slot_name, DATA_MEMORY_END);
+    }
+    FILE *var_list_fd = fopen(".temp", "a");
+    fprintf(var_list_fd, "%d %s 0\n", VAR_MEMORY_INDEX, slot_name);
+    fclose(var_list_fd);
+    VAR_MEMORY_INDEX++;
+    resolve_operand(slot_name, slot);
+}
+
+/**
+ * @brief Setup loop count, kept in a data word named after the loop line
+ *
+ */
+static void
+entering_loop(char * line)
+{
+    (void)line;
+    char slot_name[MAX_OPERAND_NAME];
+    struct operand counter;
+
+    push_block(BLOCK_LOOP);
+    int loop_amount = atoi(strtok(NULL, " "));
+    write_comment("Loop begins");
+
+    memset(&counter, 0, sizeof(counter));
+    if(loop_amount != -1)
+    {
+        //An inlined proc compiles its loops again, those copies never run
+        //at the same time so they share the word
+        snprintf(slot_name, sizeof(slot_name), ".loop%d", line_index);
+        if(symbol_exists(slot_name)) resolve_operand(slot_name, &counter);
+        else allocate_slot(slot_name, &counter);
+    }
+    backend->loop_begin(loop_amount, &counter);
+}
 /**
  * @brief checks if loop should continue
  *
@@ -541,105 +960,191 @@ entering_loop(char * line)
 static void
 end_loop(char * line)
 {
-    fprintf(samco_fd, "\n//Loop end\n");
-    fprintf(samco_fd, "lshf r4 0x00\n");
-    fprintf(samco_fd, "lshf r4 0x01\n");
-    fprintf(samco_fd, "add r2 r4\n");
-    fprintf(samco_fd, "lshf r4 0x00\n");
-    fprintf(samco_fd, "lshf r4 0x00\n");
-    fprintf(samco_fd, "add r4 r2\n");
-    fprintf(samco_fd, "sub r1 r4\n");
-    if(inside_an_infinite_loop == 1) fprintf(samco_fd, "lshf DR 0x00");
-    fprintf(samco_fd, "jz r3\n");
-    asm_instruction_addr = asm_instruction_addr + 8;
+    (void)line;
+    write_comment("Loop end");
+    backend->loop_end(line_index);
 }
 
 /**
- * @brief Setup if statement with values to compare
- *        Also writes FAKE jz instruction to be replaced once > bracket is found
+ * @brief Setup if statement with the var and value to compare, the body
+ *        runs when they are equal
+ *
+ *        A body the profile says is cold is written after the program
+ *        instead, so not equal falls straight through
  *
  */
 static void
 entering_if_statement(char * line)
 {
+    (void)line;
 
     char * var_name = strtok(NULL, " ");
-    int var_addr = get_operand_addr(var_name);
-
-    int upper_digits_var_addr = var_addr / 100;
-    int lower_digits_var_addr = var_addr % 100;
-    fprintf(samco_fd, "\n//If statement begins\n");
-    fprintf(samco_fd, "lshf r1 0x%02d\n", upper_digits_var_addr);
-    fprintf(samco_fd, "lshf r1 0x%02d\n", lower_digits_var_addr);
-    fprintf(samco_fd, "get r2 r1\n");
+    char * compare_operator = strtok(NULL, " ");
+    char * compare_string = strtok(NULL, " ");
+    if(var_name == NULL || compare_operator == NULL || compare_string == NULL
+       || strcmp(compare_operator, "==") != 0)
+    {
+        fatal_error("Expected 'if <name> == <value>' on line: %d\n", line_index);
+    }
 
-    int compare_value = atoi(strtok(NULL, " "));
+    int cold = profile_if_body_is_cold(line_index);
+    if(!cold && if_depth >= MAX_NESTED_BLOCKS)
+    {
+        fatal_error("If statements nested too deep on line: %d\n", line_index);
+    }
+    write_comment("If statement begins");
+    struct operand var;
+    resolve_value_operand(var_name, &var);
+    int compare_value = atoi(compare_string);
 
-    fprintf(samco_fd, "lshf r1 0x%02x\n", (compare_value >> 8) & 0xFF);
-    fprintf(samco_fd, "lshf r1 0x%02x\n", compare_value & 0xFF);
+    if(cold)
+    {
+        cold_bodies = realloc(cold_bodies, (cold_body_count + 1) * sizeof(*cold_bodies));
+        if(cold_bodies == NULL) fatal_error("Out of memory\n");
+        cold_bodies[cold_body_count].if_line = line_index;
+        cold_bodies[cold_body_count].end_line = profile_if_end_line(line_index);
+        cold_bodies[cold_body_count].cold_if = backend->cold_if_begin(&var, compare_value);
+        cold_body_count++;
+
+        //parse_line_code skips the body up to and including the >
+        cold_body_end_line = profile_if_end_line(line_index);
+        return;
+    }
 
-    fprintf(samco_fd, "sub r2 r1\n");
+    if_depth++;
+    backend->if_begin(&var, compare_value);
+}
 
-    fprintf(samco_fd, "IF JZ\n"); //this line gets edited to correct value for r3
-    asm_instruction_addr = asm_instruction_addr + 7;
-    start_of_if_statement = asm_instruction_addr - 1;
+/**
+ * @brief Closes the innermost open if statement
+ *
+ */
+static void
+end_of_if_statement(char *line)
+{
+    (void)line;
+    if(if_depth == 0)
+    {
+        fatal_error("> without matching if on line: %d\n", line_index);
+    }
+    if_depth--;
+    backend->if_end();
+}
+/**
+ * @brief Name of the data word a non-leaf proc saves its return addr in.
+ *        The leading . keeps it local to the module for SCC-link.
+ *
+ */
+static void
+proc_return_slot_name(struct proc *proc, char *slot_name)
+{
+    sprintf(slot_name, ".%s.ret", proc->name);
 }
 
 /**
- * @brief Replaces fake JZ "IZ JZ" with correct JZ statement and loads r3 addr
+ * @brief Writes a proc out of line behind a jump, or skips its body when
+ *        every call site inlines it
+ *
+ * @param line proc keyword - strtok is set to this
  *
  */
 static void
-replace_if_jz_with_correct_value()
+entering_proc(char * line)
 {
-    char buffer[MAX_LINE_SIZE_CHAR];
-    fclose(samco_fd);
-    FILE *file = fopen(samco_filename, "r");
-    if(file == NULL) fatal_error("Failed to open samco_fd\n");
-    FILE *tempFile = fopen("if_tempfile.tmp", "w");
-    if (tempFile == NULL) fatal_error("Failed to make if_tempfile.tmp\n");
+    (void)line;
+    char slot_name[MAX_PROC_NAME + 8];
+    struct operand return_slot;
+    struct proc *proc = procs_find(strtok(NULL, " "));
 
-    while (fgets(buffer, sizeof(buffer), file))
+    if(proc->inlined)
     {
-        if (strstr(buffer, "sub r2 r1") != NULL)
-        {
-            int upper_digits_asm_instruct = (asm_instruction_addr+3) / 100;
-            int lower_digits_asm_instruct = (asm_instruction_addr+3) % 100;
+        skip_until_line = proc->last_line;
+        return;
+    }
 
-            fprintf(tempFile, "lshf r3 0x%02x\n", upper_digits_asm_instruct);
-            fprintf(tempFile, "lshf r3 0x%02x\n", lower_digits_asm_instruct);
-            fprintf(tempFile, "sub r2 r1\n");
-            fprintf(tempFile, "JZ r3\n");
+    push_block(BLOCK_PROC);
+    open_proc = proc;
+    write_comment("proc %s", proc->name);
 
-            asm_instruction_addr = asm_instruction_addr + 2;
-        }
-        else if (strstr(buffer, "IF JZ") != NULL)
-        {
-            //Nothing we are removing this line
-        }
-        else
-        {
-            fputs(buffer, tempFile);
-        }
+    //Calls inside the body overwrite the return addr so it is saved
+    memset(&return_slot, 0, sizeof(return_slot));
+    if(!proc->is_leaf)
+    {
+        proc_return_slot_name(proc, slot_name);
+        allocate_slot(slot_name, &return_slot);
     }
-
-    // Close both files
-    fclose(tempFile);
-    fclose(file);
-    if (remove(samco_filename) != 0) fatal_error("Failed to remove file\n");
-    if (rename("if_tempfile.tmp", samco_filename) != 0)
+    backend->proc_begin(proc, &return_slot);
+}
+/**
+ * @brief Returns to the caller
+ *
+ */
+static void
+end_proc(char * line)
+{
+    (void)line;
+    char slot_name[MAX_PROC_NAME + 8];
+    struct operand return_slot;
+    struct proc *proc = open_proc;
+
+    write_comment("proc %s returns", proc->name);
+    memset(&return_slot, 0, sizeof(return_slot));
+    if(!proc->is_leaf)
     {
-        fatal_error("Failed to remove file\n");
+        proc_return_slot_name(proc, slot_name);
+        resolve_operand(slot_name, &return_slot);
     }
-
-    samco_fd = fopen(samco_filename, "a");
-    if(samco_fd == NULL) fatal_error("Failed to open file %s\n", samco_filename);
+    backend->proc_end(proc, &return_slot);
+    open_proc = NULL;
 }
+static void parse_line_code(char * line);
 
+/**
+ * @brief Compiles the proc body again at the call site
+ *
+ */
 static void
-end_of_if_statement(char *line)
+inline_proc(struct proc *proc)
+{
+    char line_buffer[MAX_LINE_SIZE_CHAR];
+    int call_line_index = line_index;
+
+    write_comment("call %s (inlined)", proc->name);
+    for(int i = 0; i < proc->body_count; i++)
+    {
+        strcpy(line_buffer, proc->body[i]);
+        //line table entries point at the proc body
+        line_index = proc->body_line_index[i];
+        parse_line_code(line_buffer);
+    }
+    line_index = call_line_index;
+}
+
+/**
+ * @brief Writes a call to the proc, or the proc body when it is inlined
+ *
+ * @return 1 if a call was written, 0 if the proc was inlined
+ *
+ */
+static int
+call_proc(char * line)
 {
-    replace_if_jz_with_correct_value();
+    (void)line;
+    struct proc *proc = procs_find(strtok(NULL, " "));
+
+    if(proc->inlined)
+    {
+        inline_proc(proc);
+        return 0;
+    }
+    if(proc == open_proc)
+    {
+        fatal_error("proc %s calls itself on line: %d\n", proc->name, line_index);
+    }
+
+    write_comment("call %s", proc->name);
+    backend->call(proc);
+    return 1;
 }
 
 /**
@@ -649,6 +1154,13 @@ end_of_if_statement(char *line)
 static void
 parse_line_code(char * line)
 {
+    //body of a cold if, written after the program
+    if(cold_body_end_line != 0)
+    {
+        if(line_index == cold_body_end_line) cold_body_end_line = 0;
+        return;
+    }
+
     if(strcmp(line, "\n") == 0) return;
     remove_newline(line);
     if(strcmp(line, "CODE_END") == 0)
@@ -658,10 +1170,17 @@ parse_line_code(char * line)
     }
 
     char *column_0 = strtok(line, " ");
+    int statement_start_addr = backend->addr();
+    enum LINE_CONSTRUCTS construct = CONSTRUCT_NONE;
 
     if(strcmp(column_0, "var") == 0)
     {
         save_variable(line);
+        construct = CONSTRUCT_VAR;
+    }
+    else if(strcmp(column_0, "extern") == 0)
+    {
+        save_extern_variable(line);
     }
     else if(strcmp(column_0, "//") == 0)
     {
@@ -670,6 +1189,7 @@ parse_line_code(char * line)
     else if(strcmp(column_0, "loop") == 0)
     {
         entering_loop(line);
+        construct = CONSTRUCT_LOOP;
     }
     else if(strcmp(column_0, "{") == 0)
     {
@@ -677,11 +1197,44 @@ parse_line_code(char * line)
     }
     else if(strcmp(column_0, "}") == 0)
     {
-        end_loop(line);
+        if(block_depth == 0)
+        {
+            fatal_error("} without matching loop or proc on line: %d\n", line_index);
+        }
+        if(block_stack[--block_depth] == BLOCK_PROC)
+        {
+            end_proc(line);
+            construct = CONSTRUCT_PROC;
+        }
+        else
+        {
+            end_loop(line);
+            construct = CONSTRUCT_LOOP;
+        }
+    }
+    else if(strcmp(column_0, "proc") == 0)
+    {
+        entering_proc(line);
+        construct = CONSTRUCT_PROC;
+    }
+    else if(strcmp(column_0, "call") == 0)
+    {
+        if(call_proc(line)) construct = CONSTRUCT_CALL;
+    }
+    else if(strcmp(column_0, "fill") == 0)
+    {
+        fill_array(line);
+        construct = CONSTRUCT_ASSIGNMENT;
+    }
+    else if(strcmp(column_0, "copy") == 0)
+    {
+        copy_array(line);
+        construct = CONSTRUCT_ASSIGNMENT;
     }
     else if(strcmp(column_0, "if") == 0)
     {
         entering_if_statement(line);
+        construct = CONSTRUCT_IF;
     }
     else if(strcmp(column_0, "<") == 0)
     {
@@ -695,21 +1248,78 @@ parse_line_code(char * line)
     {
         //If none of the keywords then a variable name
         perform_operation(line);
+        construct = CONSTRUCT_ASSIGNMENT;
+    }
+
+    if(construct != CONSTRUCT_NONE)
+    {
+        line_table_add(statement_start_addr, backend->addr(), line_index,
+                       construct);
+        if(block_leader_pending && backend->addr() > statement_start_addr)
+        {
+            profile_block_map_add(statement_start_addr, line_index);
+            block_leader_pending = 0;
+        }
     }
 
+    //Whatever comes next is jumped to or starts after a jump
+    if(construct == CONSTRUCT_IF || construct == CONSTRUCT_LOOP
+       || construct == CONSTRUCT_PROC || construct == CONSTRUCT_CALL
+       || strcmp(column_0, ">") == 0)
+    {
+        block_leader_pending = 1;
+    }
 }
 
+/**
+ * @brief Compiles lines first_line to last_line of the .scc file again
+ *
+ */
 static void
-open_samco_output_file()
+replay_lines(int first_line, int last_line)
 {
-    samco_fd = fopen(samco_filename, "w");
-    if(samco_fd == NULL) fatal_error("SamCO output file failed to open\n");
+    char line_buffer[MAX_LINE_SIZE_CHAR];
+    int call_line_index = line_index;
+
+    FILE *replay_fd = fopen(scc16_filename, "r");
+    if(replay_fd == NULL) fatal_error("Failed to open %s\n", scc16_filename);
+    for(line_index = 1; fgets(line_buffer, sizeof(line_buffer), replay_fd) != NULL
+                        && line_index <= last_line; line_index++)
+    {
+        if(line_index >= first_line) parse_line_code(line_buffer);
+    }
+    fclose(replay_fd);
+    line_index = call_line_index;
 }
 
+/**
+ * @brief Writes the cold if bodies after the program. Each one ends with
+ *        a jump back to the statement after its if. Cold ifs inside them
+ *        add more bodies which are written here as well.
+ *
+ */
 static void
-close_samco_output_file()
+write_cold_bodies()
 {
-    if(samco_fd != NULL) fclose(samco_fd);
+    if(cold_body_count == 0) return;
+
+    //Stop here so the program does not run into the bodies
+    backend->program_end();
+
+    for(int i = 0; i < cold_body_count; i++)
+    {
+        struct cold_body body = cold_bodies[i];
+
+        backend->cold_body_begin(body.cold_if);
+        write_comment("Cold body of if on line %d", body.if_line);
+        block_leader_pending = 1;
+        replay_lines(body.if_line + 1, body.end_line - 1);
+
+        int start_addr = backend->addr();
+        write_comment("Back to line %d", body.end_line);
+        backend->cold_body_end(body.cold_if);
+        line_table_add(start_addr, backend->addr(), body.if_line, CONSTRUCT_IF);
+    }
 }
 
 static void
@@ -720,6 +1330,205 @@ clear_saved_vars()
     fclose(saved_vars_fd);
 }
 
+/**
+ * @brief Appends each line of filename to the object with add_line
+ *
+ */
+static void
+read_into_object(char * filename,
+                 void (*add_line)(struct object_file *, const char *))
+{
+    char buffer[MAX_LINE_SIZE_CHAR];
+    FILE *fd = fopen(filename, "r");
+    if(fd == NULL) fatal_error("Failed to open %s\n", filename);
+
+    while(fgets(buffer, sizeof(buffer), fd) != NULL)
+    {
+        remove_newline(buffer);
+        if(add_line == object_add_line_table_entry
+           && strncmp(buffer, "//", 2) == 0) continue;
+        add_line(&module_object, buffer);
+    }
+    fclose(fd);
+    if(remove(filename) != 0) fatal_error("Failed to remove %s\n", filename);
+}
+
+/**
+ * @brief Reads every name in .temp once. A name declared again keeps the
+ *        entry get_operand_addr finds, the first one.
+ *
+ * @return number of symbols, free *symbols when done
+ *
+ */
+static int
+read_symbols(struct symbol **symbols)
+{
+    char buffer[MAX_LINE_SIZE_CHAR];
+    int count = 0;
+
+    *symbols = NULL;
+    FILE *var_list_fd = fopen(".temp", "r");
+    if(var_list_fd == NULL) fatal_error("Failed to open var_list_fd\n");
+    while(fgets(buffer, sizeof(buffer), var_list_fd) != NULL)
+    {
+        char *var_addr = strtok(buffer, " ");
+        char *var_name = strtok(NULL, " \n");
+        char *var_value = strtok(NULL, " \n");
+        char *var_length = strtok(NULL, " \n");
+        if(var_addr == NULL || var_name == NULL) continue;
+
+        *symbols = realloc(*symbols, (count + 1) * sizeof(**symbols));
+        if(*symbols == NULL) fatal_error("Out of memory\n");
+        struct symbol *symbol = &(*symbols)[count++];
+        snprintf(symbol->name, sizeof(symbol->name), "%s", var_name);
+        symbol->addr = atoi(var_addr);
+        symbol->value = (var_value == NULL) ? 0 : atoi(var_value);
+        symbol->length = (var_length == NULL) ? 0 : atoi(var_length);
+        symbol->duplicate = 0;
+        for(int i = 0; i < count - 1 && !symbol->duplicate; i++)
+        {
+            symbol->duplicate = (strcmp((*symbols)[i].name, symbol->name) == 0);
+        }
+    }
+    fclose(var_list_fd);
+    return count;
+}
+
+/**
+ * @brief Packs the module's code, vars, relocations and line table into
+ *        the object file given to -c
+ *
+ */
+static void
+write_object_file()
+{
+    object_module_name(scc16_filename, module_object.module);
+    snprintf(module_object.source, MAX_SYMBOL_NAME, "%s", scc16_filename);
+    module_object.prog_memory_start = PROGRAM_MEMORY_START;
+    module_object.prog_memory_end = PROGRAM_MEMORY_END;
+    module_object.data_memory_start = DATA_MEMORY_START;
+    module_object.data_memory_end = DATA_MEMORY_END;
+    module_object.code_size = backend->addr();
+    module_object.data_size = VAR_MEMORY_INDEX;
+
+    struct symbol *symbols;
+    int symbol_count = read_symbols(&symbols);
+    for(int i = 0; i < symbol_count; i++)
+    {
+        //extern vars are already in module_object, a var declared again
+        //keeps its first declaration's storage and value
+        if(symbols[i].addr < 0 || symbols[i].duplicate) continue;
+        object_add_symbol(&module_object, symbols[i].name, symbols[i].addr,
+                          symbols[i].value, symbols[i].length);
+    }
+    free(symbols);
+
+    read_into_object(object_code_filename, object_add_code_line);
+    read_into_object(line_table_filename, object_add_line_table_entry);
+
+    object_write(object_filename, &module_object);
+    object_free(&module_object);
+}
+
+/**
+ * @brief Reorders the finished program for the target pipeline and prints
+ *        the stall report if it was asked for
+ *
+ */
+static void
+schedule_program()
+{
+    struct schedule_stats stats;
+
+    if(!schedule_enabled && !schedule_report) return;
+    if(machine_filename != NULL) machine_load(machine_filename, 1);
+    else machine_load(DEFAULT_MACHINE_FILE, 0);
+
+    schedule_file(samco_filename, schedule_enabled, &stats);
+
+    if(schedule_report)
+    {
+        printf("Schedule report for %s\n", scc16_filename);
+        printf("Instructions: %d in %d regions, %d reordered\n",
+               stats.instructions, stats.regions, stats.regions_reordered);
+        printf("Estimated stall cycles before scheduling: %d\n", stats.stalls_before);
+        printf("Estimated stall cycles after scheduling: %d\n", stats.stalls_after);
+    }
+}
+
+/**
+ * @brief Prints where every var went and how much of data memory is used
+ *
+ */
+static void
+write_layout_report()
+{
+    struct symbol *symbols;
+    int words = 0;
+    int first_addr = -1;
+    int last_addr = -1;
+
+    int symbol_count = read_symbols(&symbols);
+    printf("Data layout for %s\n", scc16_filename);
+    printf("addr words uses name\n");
+    for(int i = 0; i < symbol_count; i++)
+    {
+        struct symbol *symbol = &symbols[i];
+        int length = (symbol->length == 0) ? 1 : symbol->length;
+        //extern vars have no storage here
+        if(symbol->duplicate || symbol->addr < 0) continue;
+
+        long uses = data_layout_uses(symbol->name);
+        if(uses < 0) printf("%d %d - %s\n", symbol->addr, length, symbol->name);
+        else printf("%d %d %ld %s\n", symbol->addr, length, uses, symbol->name);
+
+        words = words + length;
+        if(first_addr < 0 || symbol->addr < first_addr) first_addr = symbol->addr;
+        if(symbol->addr + length - 1 > last_addr) last_addr = symbol->addr + length - 1;
+    }
+    free(symbols);
+
+    //Only the upper half of data memory holds vars
+    int available = VAR_MEMORY_END - VAR_MEMORY_START + 1;
+    if(available < 1) available = 1;
+    printf("vars use %d of the %d words from %d to %d (%.1f%%)", words,
+           available, VAR_MEMORY_START, VAR_MEMORY_END, 100.0 * words / available);
+    if(words > 0)
+    {
+        printf(", %d to %d with %d unused between", first_addr, last_addr,
+               last_addr - first_addr + 1 - words);
+    }
+    printf("\n");
+    if(object_mode) printf("addrs are module relative, SCC-link places them\n");
+}/**
+ * @brief Hands every var and array in .temp to the backend so it can
+ *        print their values when the program ends
+ *
+ */
+static void
+report_vars()
+{
+    struct symbol *symbols;
+    struct operand var;
+
+    if(backend->report_var == NULL) return;
+
+    int symbol_count = read_symbols(&symbols);
+    for(int i = 0; i < symbol_count; i++)
+    {
+        struct symbol *symbol = &symbols[i];
+        //Return addr slots and element entries are not vars of the program
+        if(symbol->duplicate || symbol->addr < 0 || symbol->name[0] == '.'
+           || strchr(symbol->name, '[') != NULL)
+        {
+            continue;
+        }
+
+        resolve_operand(symbol->name, &var);
+        backend->report_var(&var);
+    }
+    free(symbols);
+}
 /**
  * @brief Main state machine
  *
@@ -730,44 +1539,201 @@ compile()
 
     if (current_state == INIT)
     {
-        open_samco_output_file();
+        struct backend_options options = {object_mode, step_limit};
+        backend->open(samco_filename, &options);
+        if(backend->program_addrs)
+        {
+            sprintf(line_table_filename, "%s.lines", samco_filename);
+            line_table_open(line_table_filename, scc16_filename);
+        }
         clear_saved_vars();
         open_scc_input_file();
+        procs_set_inlining(inline_enabled, inline_threshold);
+        procs_scan(scc_fd);
+        profile_scan(scc_fd);
+        data_layout_scan(scc_fd);
+        if(profile_generate)
+        {
+            sprintf(block_map_filename, "%s.blocks", samco_filename);
+            profile_block_map_open(block_map_filename, scc16_filename);
+        }
         current_state = PRECODE;
     }
     else return;
 
     char line_buffer[MAX_LINE_SIZE_CHAR];
-    asm_instruction_addr = PROGRAM_MEMORY_START;
 
     while(fgets(line_buffer, sizeof(line_buffer), scc_fd) != NULL)
     {
         if(current_state == PRECODE) parse_line_precode(line_buffer);
-        else if(current_state == CODE) parse_line_code(line_buffer);
+        else if(current_state == CODE && line_index > skip_until_line)
+        {
+            parse_line_code(line_buffer);
+        }
         line_index++;
     }
 
-    if(current_state = CLEANUP)
+    if(current_state == CLEANUP)
     {
+        write_cold_bodies();
+        if(if_depth != 0) fatal_error("if statement missing closing >\n");
+        if(block_depth != 0) fatal_error("loop or proc missing closing }\n");
         close_scc_input_file();
-        close_samco_output_file();
+        report_vars();
+        backend->close();
+        line_table_close();
+        profile_block_map_close();
+        if(layout_report) write_layout_report();
+        if(backend == &samco_backend) schedule_program();
+        if(object_mode) write_object_file();
         return;
     }
     fatal_error("CODE_END keyword not found\n");
 }
 
+/**
+ * @brief --run: compiles the program to bytecode, runs it and prints the
+ *        final value of every var. The time taken goes to stderr so the
+ *        values can be compared between runs.
+ *
+ */
+static void
+run_program()
+{
+    struct bytecode_program program;
+    struct interp_result result;
+
+    compile();
+    bytecode_take_program(&program);
+
+    clock_t start = clock();
+    interp_run(&program, step_limit, &result);
+    double seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+    for(int i = 0; i < program.var_count; i++)
+    {
+        struct bytecode_var *var = &program.vars[i];
+        if(var->length == 0)
+        {
+            printf("%s = %u\n", var->name, program.memory[var->slot]);
+            continue;
+        }
+        printf("%s =", var->name);
+        for(int j = 0; j < var->length; j++) printf(" %u", program.memory[var->slot + j]);
+        printf("\n");
+    }
+    if(result.stopped_line != 0)
+    {
+        printf("Step limit of %ld reached in the loop on line: %d\n", step_limit,
+               result.stopped_line);
+    }
+    fprintf(stderr, "%ld steps in %.3f s\n", result.steps, seconds);
+
+    bytecode_free(&program);
+}
+
 static void
 usage()
 {
     printf("./SCC <Optional_input_name> <Optional_output_name>\n");
+    printf("./SCC -c <input_name> <object_name>\n");
+    printf("./SCC --run <Optional_input_name>\n");
     printf("\n");
     printf("<Optional_input_name>: Specifies input filepath\n");
     printf("<Optional_output_name>: Specifies output filepath\n");
+    printf("-c: Compiles one module to an object file for SCC-link\n");
+    printf("--run: Runs the program on this computer and prints every var\n");
+    printf("\n");
+    printf("Options:\n");
+    printf("--no-inline: Keeps every called proc out of line\n");
+    printf("--inline-threshold=<n>: Inlines leaf procs of up to n instructions\n");
+    printf("                        at every call site (default %d)\n",
+           DEFAULT_INLINE_THRESHOLD);
+    printf("--profile-generate: Also writes <output>.blocks, the addr and line\n");
+    printf("                    of every block for a trace tool to count\n");
+    printf("--profile-use=<file>: Uses the '<line> <count>' pairs in file to lay\n");
+    printf("                      out if bodies, vars and array loops\n");
+    printf("--layout-report: Prints where each var is placed and how much of\n");
+    printf("                 data memory is used\n");
+    printf("--no-schedule: Keeps instructions in the order they are written\n");
+    printf("--schedule-report: Prints estimated stall cycles before and after\n");
+    printf("                   scheduling\n");
+    printf("--machine=<file>: Machine description to schedule for\n");
+    printf("                  (default %s if it exists)\n", DEFAULT_MACHINE_FILE);
+    printf("--step-limit=<n>: Stops -1 loops after n passes with --run or\n");
+    printf("                  --target=x86_64 (default %ld)\n", DEFAULT_STEP_LIMIT);
+    printf("--target=<name>: samco (default) or x86_64, GNU assembler for\n");
+    printf("                 Linux that runs natively and prints every var\n");
+}
+
+static void
+parse_option(char * option)
+{
+    if(strcmp(option, "--no-inline") == 0)
+    {
+        inline_enabled = 0;
+    }
+    else if(strncmp(option, "--inline-threshold=", 19) == 0
+            && is_integer_string(option + 19))
+    {
+        inline_threshold = atoi(option + 19);
+    }
+    else if(strcmp(option, "--profile-generate") == 0)
+    {
+        profile_generate = 1;
+    }
+    else if(strncmp(option, "--profile-use=", 14) == 0 && option[14] != '\0')
+    {
+        profile_filename = option + 14;
+    }
+    else if(strcmp(option, "--layout-report") == 0)
+    {
+        layout_report = 1;
+    }
+    else if(strcmp(option, "--no-schedule") == 0)
+    {
+        schedule_enabled = 0;
+    }
+    else if(strcmp(option, "--schedule-report") == 0)
+    {
+        schedule_report = 1;
+    }
+    else if(strncmp(option, "--machine=", 10) == 0 && option[10] != '\0')
+    {
+        machine_filename = option + 10;
+    }
+    else if(strcmp(option, "--run") == 0)
+    {
+        run_mode = 1;
+    }
+    else if(strncmp(option, "--step-limit=", 13) == 0 && is_integer_string(option + 13)
+            && atol(option + 13) > 0)
+    {
+        step_limit = atol(option + 13);
+    }
+    else if(strcmp(option, "--target=samco") == 0)
+    {
+        backend = &samco_backend;
+    }
+    else if(strcmp(option, "--target=x86_64") == 0)
+    {
+        backend = &x86_64_backend;
+    }
+    else fatal_error("Option %s not understood. './SCC usage' for usage\n", option);
 }
 
 int
 main(int argc, char **argv)
 {
+    //Options start with -- and can go anywhere, the rest are positional
+    int positional_count = 0;
+    for(int i = 1; i < argc; i++)
+    {
+        if(strncmp(argv[i], "--", 2) == 0) parse_option(argv[i]);
+        else argv[++positional_count] = argv[i];
+    }
+    argc = positional_count + 1;
+
     if(argc == 2)
     {
         if(strcmp(argv[1], "usage") == 0)
@@ -775,6 +1741,7 @@ main(int argc, char **argv)
             usage();
             exit(0);
         }
+        else if(run_mode) scc16_filename = argv[1];
         else fatal_error("Arg1 not understood. './SCC usage' for usage\n");
     }
     else if(argc == 3)
@@ -782,16 +1749,44 @@ main(int argc, char **argv)
         scc16_filename = argv[1];
         samco_filename =  argv[2];
     }
+    else if(argc == 4 && strcmp(argv[1], "-c") == 0)
+    {
+        object_mode = 1;
+        scc16_filename = argv[2];
+        object_filename = argv[3];
+        //code is written here first then packed into the object
+        sprintf(object_code_filename, "%s.code.tmp", object_filename);
+        samco_filename = object_code_filename;
+        object_init(&module_object);
+    }
     else if(argc == 1)
     {
         //defaults
         scc16_filename = "main.scc";
-        samco_filename = "main.samco";
+        samco_filename = (backend == &x86_64_backend) ? "main.s" : "main.samco";
     }
     else fatal_error("./SCC usage\n");
+    if(run_mode)
+    {
+        if(argc != 1 && argc != 2) fatal_error("--run takes only an input file\n");
+        backend = &bytecode_backend;
+    }
+    if(profile_generate && object_mode)
+    {
+        fatal_error("--profile-generate needs a whole program, not -c\n");
+    }
+    //These work on SAMCO program addrs and instructions
+    if(!backend->program_addrs && (object_mode || profile_generate || schedule_report
+                                   || machine_filename != NULL))
+    {
+        fatal_error("-c, --profile-generate, --schedule-report and --machine need"
+                    " --target=samco\n");
+    }
+    if(profile_filename != NULL) profile_load(profile_filename);
     current_state = INIT;
 
-    compile();
+    if(run_mode) run_program();
+    else compile();
 
     exit(0);
 }
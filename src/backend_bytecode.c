@@ -0,0 +1,514 @@
+/*
+ * File name: backend_bytecode.c
+ * Description: Bytecode backend for --run, builds the program interp.c
+ *              runs on the host.
+ *
+ * Notes:
+ *      Every value lives in a 16 bit slot. The first 64K slots are data
+ *      memory and every var keeps its SAMCO data addr in it, so arrays,
+ *      elements with a var index and the data layout work the same as on
+ *      SAMCO. Temps and constants come after data memory. A loop keeps its
+ *      count in the data word main.c gives it.
+ *
+ *      An element with a var index is read into a temp before the
+ *      statement and written back from one after it, its addr wraps at 16
+ *      bit like the SAMCO addr does. A whole array statement is one
+ *      instruction, a source that is not an array has a step of 0 so the
+ *      same slot is used for every element.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "../include/errors.h"
+#include "../include/scc.h"
+#include "../include/procs.h"
+#include "../include/backend.h"
+#include "../include/bytecode.h"
+
+#define BYTECODE_DATA_WORDS     65536
+
+enum BYTECODE_BLOCKS
+{
+    BYTECODE_BLOCK_LOOP,
+    BYTECODE_BLOCK_FOREVER,
+    BYTECODE_BLOCK_PROC
+};
+
+struct bytecode_block
+{
+    enum BYTECODE_BLOCKS kind;
+    int start;              //instruction the loop goes back to
+    int patch;              //instruction whose target is the end
+};
+
+//if bodies written after the program
+struct bytecode_cold_if
+{
+    int branch;             //instruction that jumps to the body
+    int return_target;      //instruction the body jumps back to
+};
+
+//Where a statement writes its result
+struct bytecode_place
+{
+    int slot;               //slot to compute into
+    int base;               //array for an element with a var index, else -1
+    int index;
+};
+
+static struct bytecode_program program;
+static int temp_slot;
+static int *constants;      //slots holding constants, shared by every use
+static int constant_count = 0;
+
+static struct bytecode_block blocks[MAX_NESTED_BLOCKS];
+static int block_depth = 0;
+static int open_ifs[MAX_NESTED_BLOCKS];
+static int if_depth = 0;
+static struct bytecode_cold_if *cold_ifs = NULL;
+static int cold_if_count = 0;
+
+/**
+ * @brief Adds count slots holding value
+ *
+ * @return first new slot
+ *
+ */
+static int
+new_slots(int count, int value)
+{
+    int first = program.slot_count;
+    program.memory = realloc(program.memory,
+                             (first + count) * sizeof(*program.memory));
+    if(program.memory == NULL) fatal_error("Out of memory\n");
+    for(int i = 0; i < count; i++) program.memory[first + i] = (uint16_t)value;
+    program.slot_count = first + count;
+    return first;
+}
+
+/**
+ * @brief Slot holding a constant
+ *
+ */
+static int
+constant_slot(int value)
+{
+    value = value & 0xFFFF;
+
+    for(int i = 0; i < constant_count; i++)
+    {
+        if(program.memory[constants[i]] == value) return constants[i];
+    }
+    constants = realloc(constants, (constant_count + 1) * sizeof(int));
+    if(constants == NULL) fatal_error("Out of memory\n");
+    constants[constant_count] = new_slots(1, value);
+    return constants[constant_count++];
+}
+
+static struct bytecode_instruction *
+add_instruction(enum BYTECODE_OPCODES opcode)
+{
+    program.code = realloc(program.code,
+                           (program.code_count + 1) * sizeof(*program.code));
+    if(program.code == NULL) fatal_error("Out of memory\n");
+
+    struct bytecode_instruction *instruction = &program.code[program.code_count++];
+    memset(instruction, 0, sizeof(*instruction));
+    instruction->opcode = opcode;
+    return instruction;
+}
+
+/**
+ * @brief Where a var or element is stored. A var index leaves base and
+ *        index set and slot at a temp.
+ *
+ */
+static struct bytecode_place
+find_place(struct operand *operand)
+{
+    struct bytecode_place place = { -1, -1, -1 };
+
+    if(operand->kind == OPERAND_ELEMENT && operand->index_name[0] != '\0')
+    {
+        place.slot = temp_slot + BYTECODE_TEMP_SLOTS - 1;
+        place.base = operand->addr;
+        place.index = operand->index_addr;
+        return place;
+    }
+    place.slot = (operand->addr + operand->addend) & 0xFFFF;
+    return place;
+}
+
+/**
+ * @brief Slot holding the value of a constant, var or element. An element
+ *        with a var index is read into temp first.
+ *
+ */
+static int
+operand_slot(struct operand *operand, int temp)
+{
+    if(operand->kind == OPERAND_CONSTANT) return constant_slot(operand->value);
+
+    struct bytecode_place place = find_place(operand);
+    if(place.base < 0) return place.slot;
+
+    struct bytecode_instruction *load = add_instruction(BC_LOAD_ELEMENT);
+    load->dst = temp_slot + temp;
+    load->a = place.base;
+    load->b = place.index;
+    return load->dst;
+}
+
+/**
+ * @brief Writes the result of a statement back when it went to a temp
+ *
+ */
+static void
+store_place(struct bytecode_place place)
+{
+    if(place.base < 0) return;
+
+    struct bytecode_instruction *store = add_instruction(BC_STORE_ELEMENT);
+    store->dst = place.base;
+    store->a = place.slot;
+    store->b = place.index;
+}
+
+static enum BYTECODE_OPCODES
+operation_opcode(enum OPERATIONS operation, int whole_array)
+{
+    switch(operation)
+    {
+        case OPERATION_NONE: return whole_array ? BC_ARRAY_MOVE : BC_MOVE;
+        case OPERATION_ADD:  return whole_array ? BC_ARRAY_ADD : BC_ADD;
+        case OPERATION_SUB:  return whole_array ? BC_ARRAY_SUB : BC_SUB;
+        case OPERATION_MUL:  return whole_array ? BC_ARRAY_MUL : BC_MUL;
+        case OPERATION_DIV:  return whole_array ? BC_ARRAY_DIV : BC_DIV;
+    }
+    fatal_error("Operation not recognized\n");
+    return BC_END;
+}
+
+/**
+ * @brief Source of a whole array statement: the array, or the slot of a
+ *        value used for every element
+ *
+ * @param step set to 1 for an array, 0 for a single value
+ *
+ */
+static int
+array_source(struct operand *operand, int temp, uint8_t *step)
+{
+    if(operand->kind != OPERAND_ARRAY)
+    {
+        *step = 0;
+        return operand_slot(operand, temp);
+    }
+    *step = 1;
+    return operand->addr;
+}
+
+static void
+push_block(enum BYTECODE_BLOCKS kind, int start, int patch)
+{
+    if(block_depth >= MAX_NESTED_BLOCKS) fatal_error("Blocks nested too deep\n");
+    blocks[block_depth].kind = kind;
+    blocks[block_depth].start = start;
+    blocks[block_depth].patch = patch;
+    block_depth++;
+}
+
+static void
+bytecode_open(const char *filename, struct backend_options *options)
+{
+    //The program is kept in memory for interp_run
+    (void)filename;
+    (void)options;
+    memset(&program, 0, sizeof(program));
+    new_slots(BYTECODE_DATA_WORDS, 0);
+    temp_slot = new_slots(BYTECODE_TEMP_SLOTS, 0);
+    constant_count = 0;
+    block_depth = 0;
+    if_depth = 0;
+    cold_if_count = 0;
+}
+
+static void
+bytecode_close()
+{
+    add_instruction(BC_END);
+    free(constants);
+    constants = NULL;
+    free(cold_ifs);
+    cold_ifs = NULL;
+}
+
+static void
+bytecode_code_begin(int prog_memory_start)
+{
+    //Instructions are numbered from 0
+    (void)prog_memory_start;
+}
+
+static int
+bytecode_addr()
+{
+    return program.code_count;
+}
+
+static void
+bytecode_comment(const char *text)
+{
+    (void)text;
+}
+
+static void
+bytecode_declare_var(struct operand *var, int value)
+{
+    struct bytecode_instruction *set = add_instruction(BC_SET);
+    set->dst = find_place(var).slot;
+    set->a = value & 0xFFFF;
+}
+
+static void
+bytecode_assign(struct operand *dest, struct operand *source)
+{
+    int a = operand_slot(source, 0);
+    struct bytecode_place place = find_place(dest);
+
+    struct bytecode_instruction *move = add_instruction(BC_MOVE);
+    move->dst = place.slot;
+    move->a = a;
+    store_place(place);
+}
+
+static void
+bytecode_operate(struct operand *dest, struct operand *source1,
+                 enum OPERATIONS operation, struct operand *source2)
+{
+    int a = operand_slot(source1, 0);
+    int b = operand_slot(source2, 1);
+    struct bytecode_place place = find_place(dest);
+
+    struct bytecode_instruction *instruction = add_instruction(operation_opcode(operation, 0));
+    instruction->dst = place.slot;
+    instruction->a = a;
+    instruction->b = b;
+    store_place(place);
+}
+
+static void
+bytecode_array_statement(struct operand *dest, struct operand *source1,
+                         enum OPERATIONS operation, struct operand *source2,
+                         int unroll)
+{
+    //One instruction covers every element, unrolling is for SAMCO
+    (void)unroll;
+    uint8_t a_step;
+    uint8_t b_step = 0;
+    int a = array_source(source1, 0, &a_step);
+    int b = 0;
+    if(operation != OPERATION_NONE) b = array_source(source2, 1, &b_step);
+
+    struct bytecode_instruction *instruction = add_instruction(operation_opcode(operation, 1));
+    instruction->dst = dest->addr;
+    instruction->a = a;
+    instruction->b = b;
+    instruction->a_step = a_step;
+    instruction->b_step = b_step;
+    instruction->count = dest->length;
+}
+
+/**
+ * @brief A loop of 0 is skipped, -1 loops until the step limit, any other
+ *        amount is taken as 16 bit
+ *
+ */
+static void
+bytecode_loop_begin(int amount, struct operand *counter)
+{
+    if(amount == -1)
+    {
+        push_block(BYTECODE_BLOCK_FOREVER, program.code_count, -1);
+        return;
+    }
+
+    struct bytecode_instruction *begin = add_instruction(BC_LOOP_BEGIN);
+    begin->dst = find_place(counter).slot;
+    begin->a = amount & 0xFFFF;
+    push_block(BYTECODE_BLOCK_LOOP, program.code_count, program.code_count - 1);
+}
+
+static void
+bytecode_loop_end(int line)
+{
+    struct bytecode_block block = blocks[--block_depth];
+
+    if(block.kind == BYTECODE_BLOCK_FOREVER)
+    {
+        struct bytecode_instruction *forever = add_instruction(BC_LOOP_FOREVER);
+        forever->target = block.start;
+        forever->line = line;
+        return;
+    }
+
+    struct bytecode_instruction *end = add_instruction(BC_LOOP_END);
+    end->dst = program.code[block.patch].dst;
+    end->target = block.start;
+    program.code[block.patch].target = program.code_count;
+}
+
+static void
+bytecode_if_begin(struct operand *var, int value)
+{
+    if(if_depth >= MAX_NESTED_BLOCKS) fatal_error("If statements nested too deep\n");
+
+    int slot = operand_slot(var, 0);
+    struct bytecode_instruction *compare = add_instruction(BC_IF_NOT_EQUAL);
+    compare->a = slot;
+    compare->b = value & 0xFFFF;
+    open_ifs[if_depth++] = program.code_count - 1;
+}
+
+static void
+bytecode_if_end()
+{
+    program.code[open_ifs[--if_depth]].target = program.code_count;
+}
+
+/**
+ * @brief Like bytecode_if_begin but equal jumps to the body written after
+ *        the program, so not equal falls straight through
+ *
+ * @return cold if to pass to bytecode_cold_body_begin and _end
+ *
+ */
+static int
+bytecode_cold_if_begin(struct operand *var, int value)
+{
+    int slot = operand_slot(var, 0);
+    struct bytecode_instruction *compare = add_instruction(BC_IF_EQUAL);
+    compare->a = slot;
+    compare->b = value & 0xFFFF;
+
+    cold_ifs = realloc(cold_ifs, (cold_if_count + 1) * sizeof(*cold_ifs));
+    if(cold_ifs == NULL) fatal_error("Out of memory\n");
+    cold_ifs[cold_if_count].branch = program.code_count - 1;
+    cold_ifs[cold_if_count].return_target = program.code_count;
+    return cold_if_count++;
+}
+
+static void
+bytecode_program_end()
+{
+    add_instruction(BC_END);
+}
+
+static void
+bytecode_cold_body_begin(int cold_if)
+{
+    program.code[cold_ifs[cold_if].branch].target = program.code_count;
+}
+
+static void
+bytecode_cold_body_end(int cold_if)
+{
+    add_instruction(BC_JUMP)->target = cold_ifs[cold_if].return_target;
+}
+
+/**
+ * @brief The proc is jumped over and only runs through call, interp_run
+ *        keeps the return addr so the return slot is not used
+ *
+ */
+static void
+bytecode_proc_begin(struct proc *proc, struct operand *return_slot)
+{
+    (void)return_slot;
+    add_instruction(BC_JUMP);
+    proc->entry_addr = program.code_count;
+    push_block(BYTECODE_BLOCK_PROC, program.code_count, program.code_count - 1);
+}
+
+static void
+bytecode_proc_end(struct proc *proc, struct operand *return_slot)
+{
+    (void)proc;
+    (void)return_slot;
+    struct bytecode_block block = blocks[--block_depth];
+
+    add_instruction(BC_RETURN);
+    program.code[block.patch].target = program.code_count;
+}
+
+static void
+bytecode_call(struct proc *proc)
+{
+    add_instruction(BC_CALL)->target = proc->entry_addr;
+}
+
+static void
+bytecode_report_var(struct operand *var)
+{
+    if(strlen(var->name) >= MAX_BYTECODE_NAME) fatal_error("var name too long: %s\n", var->name);
+
+    program.vars = realloc(program.vars, (program.var_count + 1) * sizeof(*program.vars));
+    if(program.vars == NULL) fatal_error("Out of memory\n");
+
+    struct bytecode_var *report = &program.vars[program.var_count++];
+    strcpy(report->name, var->name);
+    report->slot = var->addr;
+    report->length = (var->kind == OPERAND_ARRAY) ? var->length : 0;
+}
+
+/**
+ * @brief Hands the finished program to the caller, who frees it with
+ *        bytecode_free
+ *
+ */
+void
+bytecode_take_program(struct bytecode_program *compiled)
+{
+    *compiled = program;
+    memset(&program, 0, sizeof(program));
+}
+
+void
+bytecode_free(struct bytecode_program *compiled)
+{
+    free(compiled->code);
+    free(compiled->vars);
+    free(compiled->memory);
+    memset(compiled, 0, sizeof(*compiled));
+}
+
+struct backend bytecode_backend =
+{
+    .name = "bytecode",
+    .program_addrs = 0,
+    .open = bytecode_open,
+    .close = bytecode_close,
+    .code_begin = bytecode_code_begin,
+    .addr = bytecode_addr,
+    .comment = bytecode_comment,
+    .declare_var = bytecode_declare_var,
+    .assign = bytecode_assign,
+    .operate = bytecode_operate,
+    .array_statement = bytecode_array_statement,
+    .loop_begin = bytecode_loop_begin,
+    .loop_end = bytecode_loop_end,
+    .if_begin = bytecode_if_begin,
+    .if_end = bytecode_if_end,
+    .cold_if_begin = bytecode_cold_if_begin,
+    .program_end = bytecode_program_end,
+    .cold_body_begin = bytecode_cold_body_begin,
+    .cold_body_end = bytecode_cold_body_end,
+    .proc_begin = bytecode_proc_begin,
+    .proc_end = bytecode_proc_end,
+    .call = bytecode_call,
+    .report_var = bytecode_report_var
+};
+
+/* End of file: backend_bytecode.c */
\ No newline at end of file
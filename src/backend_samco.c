@@ -0,0 +1,873 @@
+/*
+ * File name: backend_samco.c
+ * Description: SAMCO backend, writes the .samco assembly for the device.
+ *
+ * Notes:
+ *      Registers: DR and r1 to r7, all 16 bit. Only lshf loads a constant,
+ *      one byte at a time, so every constant, data addr and program addr
+ *      is loaded with up to two lshf. The value each register holds is
+ *      remembered so a load that is not needed is skipped. Every addr a
+ *      jump can land on forgets them, the backend knows all of those.
+ *
+ *      Jumps: jz to the program addr in a register when the last add,
+ *      sub, mul or div gave 0, sub <reg> <reg> first to always jump. A
+ *      forward jump is written with FIXUP_<id>_HI/LO placeholders that are
+ *      patched in the file once the target is known. With -c every addr
+ *      is a %hi/%lo relocation for SCC-link instead.
+ *
+ *      asm_instruction_addr is kept by hand next to every instruction
+ *      written, the jump targets depend on it.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <stdlib.h>
+#include <stdarg.h>
+
+#include "../include/errors.h"
+#include "../include/scc.h"
+#include "../include/object.h"
+#include "../include/procs.h"
+#include "../include/backend.h"
+
+static FILE *samco_fd;
+static char output_filename[MAX_LINE_SIZE_CHAR];
+static int object_mode = 0;
+
+static int asm_instruction_addr;
+
+struct samco_loop
+{
+    int forever;
+    int top;                    //first addr of the body
+    int exit_fixup_id;          //-1 unless a loop of 0 jumps past the body
+    struct operand counter;
+};
+static struct samco_loop loop_stack[MAX_NESTED_BLOCKS];
+static int loop_depth = 0;
+
+static int if_fixup_stack[MAX_NESTED_BLOCKS];
+static int if_depth = 0;
+static int next_fixup_id = 0;
+static int proc_fixup_id = 0;
+static int module_end_fixup_id = -1;    //program end jump with -c
+
+//if bodies written after the program
+struct cold_if
+{
+    int fixup_id;
+    int return_addr;
+};
+static struct cold_if *cold_ifs = NULL;
+static int cold_if_count = 0;
+
+//What the emitter knows a register holds, kept up to date by emit
+enum REGISTER_KNOWLEDGE
+{
+    REG_UNKNOWN,
+    REG_LOW_BYTE_KNOWN,
+    REG_KNOWN
+};
+struct register_value
+{
+    enum REGISTER_KNOWLEDGE known;
+    int value;
+};
+static struct register_value register_values[8];
+
+/**
+ * @brief DR is 0, r1 to r7 are 1 to 7
+ *
+ * @return -1 if reg is not a register
+ *
+ */
+static int
+register_number(const char * reg)
+{
+    if(strcmp(reg, "DR") == 0) return 0;
+    if(reg[0] == 'r' && reg[1] >= '1' && reg[1] <= '7' && reg[2] == '\0')
+    {
+        return reg[1] - '0';
+    }
+    return -1;
+}
+
+/**
+ * @brief Forgets every register value, the next instruction may be
+ *        jumped to
+ *
+ */
+static void
+forget_registers()
+{
+    for(int i = 0; i < 8; i++) register_values[i].known = REG_UNKNOWN;
+}
+
+/**
+ * @brief Updates the known register values for one written line
+ *
+ */
+static void
+track_instruction(char * line)
+{
+    char buffer[MAX_LINE_SIZE_CHAR];
+    char opcode[16];
+    char first[16];
+    char second[16];
+
+    snprintf(buffer, sizeof(buffer), "%s", line);
+    for(char *c = buffer; *c != '\0'; c++) if(*c == ',') *c = ' ';
+    int count = sscanf(buffer, "%15s %15s %15s", opcode, first, second);
+    if(count < 1 || strncmp(opcode, "//", 2) == 0) return;
+
+    int reg = (count > 1) ? register_number(first) : -1;
+    struct register_value *known = &register_values[(reg < 0) ? 0 : reg];
+
+    if(strcasecmp(opcode, "put") == 0) return;
+    if(strcasecmp(opcode, "lshf") == 0 && reg >= 0 && count == 3)
+    {
+        //Placeholders and relocations are not known yet
+        if(strncmp(second, "0x", 2) != 0) known->known = REG_UNKNOWN;
+        else
+        {
+            int byte = strtol(second, NULL, 16) & 0xFF;
+            if(known->known == REG_UNKNOWN) known->known = REG_LOW_BYTE_KNOWN;
+            else known->known = REG_KNOWN;
+            known->value = ((known->value << 8) | byte) & 0xFFFF;
+        }
+    }
+    else if(strcasecmp(opcode, "sub") == 0 && reg >= 0 && count == 3
+            && strcmp(first, second) == 0)
+    {
+        known->known = REG_KNOWN;
+        known->value = 0;
+    }
+    else if(reg >= 0 && strcasecmp(opcode, "jz") != 0) known->known = REG_UNKNOWN;
+    else forget_registers();
+}
+
+/**
+ * @brief Writes to the samco output, every instruction goes through here
+ *
+ */
+static void
+emit(const char * format, ...)
+{
+    char buffer[MAX_LINE_SIZE_CHAR];
+    va_list args;
+
+    va_start(args, format);
+    vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    fputs(buffer, samco_fd);
+
+    for(char *line = buffer; *line != '\0';)
+    {
+        char *newline = strchr(line, '\n');
+        if(newline != NULL) *newline = '\0';
+        track_instruction(line);
+        if(newline == NULL) break;
+        line = newline + 1;
+    }
+}
+
+/**
+ * @brief Loads value into reg with as few lshf as the known value of reg
+ *        allows: none if it already holds value, one if its low byte is
+ *        the high byte of value
+ *
+ * @return number of instructions written
+ *
+ */
+static int
+write_value_load(char * reg, int value)
+{
+    struct register_value *known = &register_values[register_number(reg)];
+    value = value & 0xFFFF;
+
+    if(known->known == REG_KNOWN && known->value == value) return 0;
+
+    int written = 0;
+    if(known->known == REG_UNKNOWN || (known->value & 0xFF) != (value >> 8))
+    {
+        emit("lshf %s 0x%02x\n", reg, value >> 8);
+        written++;
+    }
+    emit("lshf %s 0x%02x\n", reg, value & 0xFF);
+    return written + 1;
+}
+
+/**
+ * @brief Writes the lshf instructions that load the addr of a variable
+ *        into reg. With -c the bytes are left as relocations for SCC-link.
+ *
+ * @param reg register to load
+ * @param name variable to load the addr of
+ * @param addr addr of the variable
+ * @param addend added to the variable addr
+ *
+ * @return number of instructions written
+ *
+ */
+static int
+write_data_addr_load(char * reg, const char * name, int addr, int addend)
+{
+    if(object_mode)
+    {
+        emit("lshf %s %%hi(%s+%d)\n", reg, name, addend);
+        emit("lshf %s %%lo(%s+%d)\n", reg, name, addend);
+        return 2;
+    }
+    return write_value_load(reg, addr + addend);
+}
+
+/**
+ * @brief Writes the two lshf instructions that load a program addr into reg
+ *
+ * @param reg register to load
+ * @param addr program addr, module relative with -c
+ *
+ */
+static void
+write_prog_addr_load(char * reg, int addr)
+{
+    if(object_mode)
+    {
+        emit("lshf %s %%hi(%s+%d)\n", reg, OBJECT_PROG_SYMBOL, addr);
+        emit("lshf %s %%lo(%s+%d)\n", reg, OBJECT_PROG_SYMBOL, addr);
+        return;
+    }
+    emit("lshf %s 0x%02x\n", reg, (addr >> 8) & 0xFF);
+    emit("lshf %s 0x%02x\n", reg, addr & 0xFF);
+}
+
+/**
+ * @brief Loads the addr of a var or of an array element into reg.
+ *        A constant index is folded into the addr, a var index is read at
+ *        runtime and added to the array addr using r4.
+ *
+ * @return number of instructions written
+ *
+ */
+static int
+write_operand_addr_load(char * reg, struct operand *operand)
+{
+    if(operand->kind != OPERAND_ELEMENT || operand->index_name[0] == '\0')
+    {
+        return write_data_addr_load(reg, operand->name, operand->addr, operand->addend);
+    }
+
+    int written = write_data_addr_load(reg, operand->index_name, operand->index_addr, 0);
+    emit("GET %s %s\n", reg, reg);
+    written = written + write_data_addr_load("r4", operand->name, operand->addr, 0);
+    emit("add %s r4\n", reg);
+    return written + 2;
+}
+
+static char *
+arithmetic_instruction(enum OPERATIONS operation)
+{
+    switch(operation)
+    {
+        case OPERATION_ADD: return "add";
+        case OPERATION_SUB: return "sub";
+        case OPERATION_MUL: return "mul";
+        case OPERATION_DIV: return "div";
+        default:            fatal_error("Operation not recognized\n");
+    }
+    return NULL;
+}
+
+/**
+ * @brief Loads an array loop source into reg: the array addr, or the value
+ *        of a constant, var or element that is used for every element
+ *
+ * @return number of instructions written
+ *
+ */
+static int
+load_array_source(char * reg, struct operand *operand)
+{
+    if(operand->kind == OPERAND_ARRAY)
+    {
+        return write_data_addr_load(reg, operand->name, operand->addr, 0);
+    }
+    if(operand->kind == OPERAND_CONSTANT) return write_value_load(reg, operand->value);
+    int written = write_operand_addr_load(reg, operand);
+    emit("GET %s %s\n", reg, reg);
+    return written + 1;
+}
+
+/**
+ * @brief Replaces the FIXUP_<id>_HI/LO placeholders with the bytes of addr
+ *
+ * @param fixup_id placeholder id handed out when the jump was written
+ * @param addr program address the placeholder should load
+ *
+ */
+static void
+resolve_fixup(int fixup_id, int addr)
+{
+    char buffer[MAX_LINE_SIZE_CHAR];
+    char hi_placeholder[32];
+    char lo_placeholder[32];
+    sprintf(hi_placeholder, "FIXUP_%d_HI", fixup_id);
+    sprintf(lo_placeholder, "FIXUP_%d_LO", fixup_id);
+
+    fclose(samco_fd);
+    FILE *file = fopen(output_filename, "r");
+    if(file == NULL) fatal_error("Failed to open samco_fd\n");
+    FILE *tempFile = fopen("if_tempfile.tmp", "w");
+    if (tempFile == NULL) fatal_error("Failed to make if_tempfile.tmp\n");
+
+    while (fgets(buffer, sizeof(buffer), file))
+    {
+        char *placeholder = strstr(buffer, hi_placeholder);
+        char *byte = "hi";
+        int value = (addr >> 8) & 0xFF;
+        if(placeholder == NULL)
+        {
+            placeholder = strstr(buffer, lo_placeholder);
+            byte = "lo";
+            value = addr & 0xFF;
+        }
+
+        //placeholders are always the last operand on the line
+        if(placeholder != NULL && object_mode)
+        {
+            *placeholder = '\0';
+            fprintf(tempFile, "%s%%%s(%s+%d)\n", buffer, byte,
+                                                OBJECT_PROG_SYMBOL, addr);
+        }
+        else if(placeholder != NULL)
+        {
+            *placeholder = '\0';
+            fprintf(tempFile, "%s0x%02x\n", buffer, value);
+        }
+        else
+        {
+            fputs(buffer, tempFile);
+        }
+    }
+
+    // Close both files
+    fclose(tempFile);
+    fclose(file);
+    if (remove(output_filename) != 0) fatal_error("Failed to remove file\n");
+    if (rename("if_tempfile.tmp", output_filename) != 0)
+    {
+        fatal_error("Failed to remove file\n");
+    }
+
+    samco_fd = fopen(output_filename, "a");
+    if(samco_fd == NULL) fatal_error("Failed to open file %s\n", output_filename);
+}
+
+static void
+samco_open(const char *filename, struct backend_options *options)
+{
+    snprintf(output_filename, sizeof(output_filename), "%s", filename);
+    object_mode = options->object_mode;
+    samco_fd = fopen(output_filename, "w");
+    if(samco_fd == NULL) fatal_error("SamCO output file failed to open\n");
+}
+
+static void
+samco_close()
+{
+    if(module_end_fixup_id >= 0) resolve_fixup(module_end_fixup_id, asm_instruction_addr);
+    module_end_fixup_id = -1;
+    if(samco_fd != NULL) fclose(samco_fd);
+    samco_fd = NULL;
+}
+
+static void
+samco_code_begin(int prog_memory_start)
+{
+    asm_instruction_addr = prog_memory_start;
+    forget_registers();
+}
+
+static int
+samco_addr()
+{
+    return asm_instruction_addr;
+}
+
+static void
+samco_comment(const char *text)
+{
+    emit("\n//%s\n", text);
+}
+
+/**
+ * @brief PUTs the initial value of a var into memory at its addr
+ *
+ */
+static void
+samco_declare_var(struct operand *var, int value)
+{
+    int written = write_value_load("DR", value);
+    written = written + write_data_addr_load("r7", var->name, var->addr, 0);
+    emit("PUT DR r7\n");
+
+    asm_instruction_addr = asm_instruction_addr + 1 + written;
+}
+
+/**
+ * @brief Write ASM assignment operation with variable addr and value
+ *
+ */
+static void
+samco_assign(struct operand *dest, struct operand *source)
+{
+    if(source->kind == OPERAND_CONSTANT)
+    {
+        int written = write_value_load("DR", source->value);
+        written = written + write_operand_addr_load("r6", dest);
+
+        emit("put DR r6\n");
+        asm_instruction_addr = asm_instruction_addr + 1 + written;
+    }
+    else
+    {
+        int written = write_operand_addr_load("DR", source);
+        emit("get r6 DR\n");
+
+        written = written + write_operand_addr_load("r5", dest);
+
+        emit("put r6 r5\n");
+        asm_instruction_addr = asm_instruction_addr + 2 + written;
+    }
+}
+
+/**
+ * @brief Loads an operand of a + - * / into reg, through DR for a var
+ *
+ */
+static void
+load_operation_source(char * reg, struct operand *source)
+{
+    if(source->kind == OPERAND_CONSTANT)
+    {
+        asm_instruction_addr = asm_instruction_addr
+                               + write_value_load(reg, source->value);
+        return;
+    }
+    int written = write_operand_addr_load("DR", source);
+    emit("GET %s DR\n", reg);
+    asm_instruction_addr = asm_instruction_addr + 1 + written;
+}
+
+/**
+ * @brief writes asm equivalent of operation which is one of + - / *
+ *
+ */
+static void
+samco_operate(struct operand *dest, struct operand *source1,
+              enum OPERATIONS operation, struct operand *source2)
+{
+    load_operation_source("r6", source1);
+    load_operation_source("r5", source2);
+    asm_instruction_addr = asm_instruction_addr + write_operand_addr_load("r3", dest);
+
+    // r4 = r6 <operation> r5
+    emit("%s r6 r5\n", arithmetic_instruction(operation));
+    int written = write_value_load("r4", 0);
+    emit("add r4, r6\n");
+    emit("PUT r4, r3\n");
+    asm_instruction_addr = asm_instruction_addr + 3 + written;
+}
+
+/**
+ * @brief Writes a pointer-increment loop over every element of dest:
+ *        dest[i] = source1[i] <operation> source2[i], or dest[i] = source1[i]
+ *        for OPERATION_NONE. A source that is not an array is loaded
+ *        once and used for every element. The body is unrolled up to
+ *        unroll elements per iteration.
+ *
+ *        r1 count, r2 dest ptr, r4 1, r5 source1, r6 source2,
+ *        DR and r3 scratch
+ *
+ */
+static void
+samco_array_statement(struct operand *dest, struct operand *source1,
+                      enum OPERATIONS operation, struct operand *source2,
+                      int unroll)
+{
+    int length = dest->length;
+    int source1_is_array = (source1->kind == OPERAND_ARRAY);
+    int source2_is_array = 0;
+    char *instruction = NULL;
+    if(operation != OPERATION_NONE)
+    {
+        source2_is_array = (source2->kind == OPERAND_ARRAY);
+        instruction = arithmetic_instruction(operation);
+    }
+
+    while(length % unroll != 0) unroll--;
+
+    int element_size;
+    if(operation == OPERATION_NONE) element_size = source1_is_array ? 4 : 2;
+    else
+    {
+        element_size = (source1_is_array ? 1 : 2) + (source2_is_array ? 2 : 1)
+                       + 2 + source1_is_array + source2_is_array;
+    }
+
+    //Sources first, a var index uses r4 as scratch
+    int setup_size = load_array_source("r5", source1);
+    if(operation != OPERATION_NONE)
+    {
+        setup_size = setup_size + load_array_source("r6", source2);
+    }
+    setup_size = setup_size + write_value_load("r1", length / unroll);
+    setup_size = setup_size + write_value_load("r4", 1);
+    setup_size = setup_size + write_data_addr_load("r2", dest->name, dest->addr, 0);
+    asm_instruction_addr = asm_instruction_addr + setup_size;
+
+    //Jumped back to, the scheduler must not move setup past it
+    emit("//Array loop top\n");
+    forget_registers();
+    int loop_top = asm_instruction_addr;
+    int loop_exit = loop_top + unroll * element_size + 8;
+
+    for(int i = 0; i < unroll; i++)
+    {
+        if(operation == OPERATION_NONE && !source1_is_array)
+        {
+            emit("PUT r5 r2\n");
+            emit("add r2 r4\n");
+            continue;
+        }
+
+        if(source1_is_array) emit("GET DR r5\n");
+        else
+        {
+            emit("sub DR DR\n");
+            emit("add DR r5\n");
+        }
+        if(operation != OPERATION_NONE && source2_is_array)
+        {
+            emit("GET r3 r6\n");
+            emit("%s DR r3\n", instruction);
+        }
+        else if(operation != OPERATION_NONE)
+        {
+            emit("%s DR r6\n", instruction);
+        }
+        emit("PUT DR r2\n");
+        emit("add r2 r4\n");
+        if(source1_is_array) emit("add r5 r4\n");
+        if(source2_is_array) emit("add r6 r4\n");
+    }
+
+    write_prog_addr_load("r3", loop_exit);
+    emit("sub r1 r4\n");
+    emit("jz r3\n");
+    write_prog_addr_load("r3", loop_top);
+    emit("sub DR DR\n");
+    emit("jz r3\n");
+    asm_instruction_addr = loop_exit;
+}
+
+/**
+ * @brief Stores the count in the counter word. The body may use every
+ *        register and call procs, so nothing is kept in one.
+ *
+ */
+static void
+samco_loop_begin(int amount, struct operand *counter)
+{
+    if(loop_depth >= MAX_NESTED_BLOCKS) fatal_error("Loops nested too deep\n");
+
+    struct samco_loop *loop = &loop_stack[loop_depth++];
+    loop->forever = (amount == -1);
+    loop->exit_fixup_id = -1;
+    loop->counter = *counter;
+
+    if(!loop->forever)
+    {
+        int written = write_value_load("DR", amount);
+        written = written + write_data_addr_load("r6", counter->name, counter->addr, 0);
+        emit("PUT DR r6\n");
+        asm_instruction_addr = asm_instruction_addr + 1 + written;
+
+        //A count of 0 never runs the body, these lines get edited to the exit
+        if((amount & 0xFFFF) == 0)
+        {
+            loop->exit_fixup_id = next_fixup_id++;
+            emit("lshf r3 FIXUP_%d_HI\n", loop->exit_fixup_id);
+            emit("lshf r3 FIXUP_%d_LO\n", loop->exit_fixup_id);
+            emit("sub DR DR\n");
+            emit("jz r3\n");
+            asm_instruction_addr = asm_instruction_addr + 4;
+        }
+    }
+
+    //Jumped back to from the end of the body
+    emit("//Loop top\n");
+    forget_registers();
+    loop->top = asm_instruction_addr;
+}
+
+/**
+ * @brief Takes 1 off the count and jumps back to the top unless it is 0.
+ *        There is no jump on not zero, so 0 jumps past the jump back.
+ *
+ */
+static void
+samco_loop_end(int line)
+{
+    //A -1 loop never stops on SAMCO so the line is not needed
+    (void)line;
+    struct samco_loop *loop = &loop_stack[--loop_depth];
+
+    if(!loop->forever)
+    {
+        struct operand *counter = &loop->counter;
+        int written = write_data_addr_load("r6", counter->name, counter->addr, 0);
+        emit("GET r1 r6\n");
+        written = written + write_value_load("r2", 1);
+        emit("sub r1 r2\n");
+        emit("PUT r1 r6\n");
+        asm_instruction_addr = asm_instruction_addr + 3 + written;
+
+        write_prog_addr_load("r3", asm_instruction_addr + 7);
+        emit("jz r3\n");
+        asm_instruction_addr = asm_instruction_addr + 3;
+    }
+
+    write_prog_addr_load("r3", loop->top);
+    emit("sub DR DR\n");
+    emit("jz r3\n");
+    asm_instruction_addr = asm_instruction_addr + 4;
+
+    if(loop->exit_fixup_id >= 0) resolve_fixup(loop->exit_fixup_id, asm_instruction_addr);
+    forget_registers();
+}
+
+/**
+ * @brief Loads the var into r2 and the value to compare with into r1
+ *
+ */
+static void
+write_if_compare(struct operand *var, int value)
+{
+    int written = write_operand_addr_load("r1", var);
+    emit("get r2 r1\n");
+    written = written + write_value_load("r1", value);
+    asm_instruction_addr = asm_instruction_addr + 1 + written;
+}
+
+/**
+ * @brief Setup if statement with values to compare. When equal the JZ
+ *        goes to the body, otherwise the jump after it goes past the body.
+ *        That target is not known until the > bracket so its r3 loads
+ *        are written as fixup placeholders and patched in samco_if_end
+ *
+ */
+static void
+samco_if_begin(struct operand *var, int value)
+{
+    int fixup_id = next_fixup_id++;
+    write_if_compare(var, value);
+
+    if_fixup_stack[if_depth++] = fixup_id;
+    write_prog_addr_load("r3", asm_instruction_addr + 8);
+    emit("sub r2 r1\n");
+    emit("JZ r3\n");
+
+    //these lines get edited to the correct value for r3
+    emit("lshf r3 FIXUP_%d_HI\n", fixup_id);
+    emit("lshf r3 FIXUP_%d_LO\n", fixup_id);
+    emit("sub DR DR\n");
+    emit("jz r3\n");
+    asm_instruction_addr = asm_instruction_addr + 8;
+}
+
+/**
+ * @brief Points the JZ of the innermost open if statement past its body
+ *
+ */
+static void
+samco_if_end()
+{
+    resolve_fixup(if_fixup_stack[--if_depth], asm_instruction_addr);
+
+    //Reached from the body and by the jump past it
+    forget_registers();
+}
+
+/**
+ * @brief Like samco_if_begin but the JZ goes to the body written after the
+ *        program, so not equal falls straight through
+ *
+ * @return cold if to pass to samco_cold_body_begin and samco_cold_body_end
+ *
+ */
+static int
+samco_cold_if_begin(struct operand *var, int value)
+{
+    int fixup_id = next_fixup_id++;
+    write_if_compare(var, value);
+
+    //these lines get edited to the addr of the body after the program
+    emit("lshf r3 FIXUP_%d_HI\n", fixup_id);
+    emit("lshf r3 FIXUP_%d_LO\n", fixup_id);
+    emit("sub r2 r1\n");
+    emit("JZ r3\n");
+    asm_instruction_addr = asm_instruction_addr + 4;
+    forget_registers();
+
+    cold_ifs = realloc(cold_ifs, (cold_if_count + 1) * sizeof(*cold_ifs));
+    if(cold_ifs == NULL) fatal_error("Out of memory\n");
+    cold_ifs[cold_if_count].fixup_id = fixup_id;
+    cold_ifs[cold_if_count].return_addr = asm_instruction_addr;
+    return cold_if_count++;
+}
+
+/**
+ * @brief Stops here so the program does not run into the cold bodies.
+ *        With -c the next module starts after this one's cold bodies, so
+ *        the jump goes there instead.
+ *
+ */
+static void
+samco_program_end()
+{
+    emit("\n//Program end\n");
+    forget_registers();
+    if(object_mode)
+    {
+        //resolved to the module's code size by samco_close
+        module_end_fixup_id = next_fixup_id++;
+        emit("lshf r3 FIXUP_%d_HI\n", module_end_fixup_id);
+        emit("lshf r3 FIXUP_%d_LO\n", module_end_fixup_id);
+    }
+    else write_prog_addr_load("r3", asm_instruction_addr);
+    emit("sub DR DR\n");
+    emit("jz r3\n");
+    asm_instruction_addr = asm_instruction_addr + 4;
+}
+
+static void
+samco_cold_body_begin(int cold_if)
+{
+    resolve_fixup(cold_ifs[cold_if].fixup_id, asm_instruction_addr);
+    forget_registers();
+}
+
+/**
+ * @brief Jumps back to the statement after the cold if
+ *
+ */
+static void
+samco_cold_body_end(int cold_if)
+{
+    write_prog_addr_load("r3", cold_ifs[cold_if].return_addr);
+    emit("sub DR DR\n");
+    emit("jz r3\n");
+    asm_instruction_addr = asm_instruction_addr + 4;
+}
+
+/**
+ * @brief Writes the jump over a proc body and, for a proc that calls
+ *        others, saves r7 to its return slot
+ *
+ */
+static void
+samco_proc_begin(struct proc *proc, struct operand *return_slot)
+{
+    proc_fixup_id = next_fixup_id++;
+
+    //Jump over the body, it only runs through call
+    emit("lshf r6 FIXUP_%d_HI\n", proc_fixup_id);
+    emit("lshf r6 FIXUP_%d_LO\n", proc_fixup_id);
+    emit("sub r4 r4\n");
+    emit("jz r6\n");
+    asm_instruction_addr = asm_instruction_addr + PROC_JUMP_OVER_COST;
+    proc->entry_addr = asm_instruction_addr;
+    forget_registers();
+
+    //Calls inside the body overwrite r7 so save it first
+    if(!proc->is_leaf)
+    {
+        int written = write_data_addr_load("r6", return_slot->name, return_slot->addr, 0);
+        emit("PUT r7 r6\n");
+        asm_instruction_addr = asm_instruction_addr + 1 + written;
+    }
+}
+
+/**
+ * @brief Returns to the addr the caller left in r7
+ *
+ */
+static void
+samco_proc_end(struct proc *proc, struct operand *return_slot)
+{
+    if(proc->is_leaf)
+    {
+        emit("sub r4 r4\n");
+        emit("jz r7\n");
+        asm_instruction_addr = asm_instruction_addr + PROC_LEAF_RETURN_COST;
+    }
+    else
+    {
+        int written = write_data_addr_load("r6", return_slot->name, return_slot->addr, 0);
+        emit("GET r6 r6\n");
+        emit("sub r4 r4\n");
+        emit("jz r6\n");
+        asm_instruction_addr = asm_instruction_addr + 3 + written;
+    }
+
+    resolve_fixup(proc_fixup_id, asm_instruction_addr);
+    forget_registers();
+}
+
+/**
+ * @brief Writes a call: return addr in r7 then jump to the proc entry
+ *
+ */
+static void
+samco_call(struct proc *proc)
+{
+    write_prog_addr_load("r7", asm_instruction_addr + PROC_CALL_COST);
+    write_prog_addr_load("r6", proc->entry_addr);
+    emit("sub r4 r4\n");
+    emit("jz r6\n");
+    asm_instruction_addr = asm_instruction_addr + PROC_CALL_COST;
+
+    //The proc may change any register before it returns here
+    forget_registers();
+}
+
+struct backend samco_backend =
+{
+    .name = "samco",
+    .program_addrs = 1,
+    .open = samco_open,
+    .close = samco_close,
+    .code_begin = samco_code_begin,
+    .addr = samco_addr,
+    .comment = samco_comment,
+    .declare_var = samco_declare_var,
+    .assign = samco_assign,
+    .operate = samco_operate,
+    .array_statement = samco_array_statement,
+    .loop_begin = samco_loop_begin,
+    .loop_end = samco_loop_end,
+    .if_begin = samco_if_begin,
+    .if_end = samco_if_end,
+    .cold_if_begin = samco_cold_if_begin,
+    .program_end = samco_program_end,
+    .cold_body_begin = samco_cold_body_begin,
+    .cold_body_end = samco_cold_body_end,
+    .proc_begin = samco_proc_begin,
+    .proc_end = samco_proc_end,
+    .call = samco_call,
+    .report_var = NULL
+};
+
+/* End of file: backend_samco.c */
@@ -0,0 +1,519 @@
+/*
+ * File name: backend_x86_64.c
+ * Description: x86-64 backend, writes GNU assembler (AT&T) for Linux that
+ *              runs the program natively. Build it with: cc main.s -o main
+ *
+ * Notes:
+ *      The program is main(). Data memory is the 64K words scc_data in
+ *      .bss and every var keeps its SAMCO data addr in it, so arrays,
+ *      elements with a var index and the data layout work the same.
+ *      Values are 16 bit: loaded with movzwl, worked on in 32 bit
+ *      registers and stored with movw, dividing by 0 gives 0.
+ *
+ *      Only caller saved registers are used between statements and none
+ *      of them holds anything from one statement to the next.
+ *
+ *      A loop keeps its count on the stack so loops nest and procs can be
+ *      called from inside one. A -1 loop counts its passes and stops at
+ *      the step limit. When the program ends every var is printed like
+ *      --run does.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdarg.h>
+
+#include "../include/errors.h"
+#include "../include/scc.h"
+#include "../include/procs.h"
+#include "../include/backend.h"
+
+#define X86_DATA_WORDS      65536
+
+static FILE *x86_fd;
+static long step_limit;
+
+//Lines written, there are no program addrs until the assembler runs
+static int instruction_count;
+static int next_label = 0;
+
+struct x86_loop
+{
+    int label;
+    int forever;
+};
+static struct x86_loop loop_stack[MAX_NESTED_BLOCKS];
+static int loop_depth = 0;
+
+static int if_label_stack[MAX_NESTED_BLOCKS];
+static int if_depth = 0;
+
+//Vars printed when the program ends
+static struct operand *report_vars = NULL;
+static int report_var_count = 0;
+
+static void
+emit(const char * format, ...)
+{
+    va_list args;
+
+    va_start(args, format);
+    vfprintf(x86_fd, format, args);
+    va_end(args);
+    instruction_count++;
+}
+
+/**
+ * @brief Writes the memory reference of a var or element. An element with
+ *        a var index has its addr worked out in %rdx and %rcx first, it
+ *        wraps at 16 bit like the SAMCO addr does.
+ *
+ */
+static void
+operand_reference(struct operand *operand, char *reference, size_t size)
+{
+    if(operand->kind == OPERAND_ELEMENT && operand->index_name[0] != '\0')
+    {
+        emit("\tmovzwl\tscc_data+%d(%%rip), %%ecx\t# %s\n", 2 * operand->index_addr,
+             operand->index_name);
+        emit("\taddl\t$%d, %%ecx\n", operand->addr);
+        emit("\tandl\t$0xffff, %%ecx\n");
+        emit("\tleaq\tscc_data(%%rip), %%rdx\n");
+        snprintf(reference, size, "(%%rdx,%%rcx,2)");
+        return;
+    }
+    snprintf(reference, size, "scc_data+%d(%%rip)",
+             2 * ((operand->addr + operand->addend) & 0xFFFF));
+}
+
+/**
+ * @brief Loads a constant, var or element into the 32 bit register reg
+ *
+ */
+static void
+load_operand(const char *reg, struct operand *operand)
+{
+    char reference[64];
+
+    if(operand->kind == OPERAND_CONSTANT)
+    {
+        emit("\tmovl\t$%d, %%%s\n", operand->value & 0xFFFF, reg);
+        return;
+    }
+    operand_reference(operand, reference, sizeof(reference));
+    emit("\tmovzwl\t%s, %%%s\t# %s\n", reference, reg, operand->name);
+}
+
+/**
+ * @brief Stores %ax to a var or element
+ *
+ */
+static void
+store_result(struct operand *dest)
+{
+    char reference[64];
+
+    operand_reference(dest, reference, sizeof(reference));
+    emit("\tmovw\t%%ax, %s\t# %s\n", reference, dest->name);
+}
+
+/**
+ * @brief %eax = %eax <operation> source, kept to 16 bit by the store.
+ *        Division uses %edx.
+ *
+ */
+static void
+write_operation(enum OPERATIONS operation, const char *source)
+{
+    int label;
+
+    switch(operation)
+    {
+        case OPERATION_NONE:
+            break;
+        case OPERATION_ADD:
+            emit("\taddl\t%%%s, %%eax\n", source);
+            break;
+        case OPERATION_SUB:
+            emit("\tsubl\t%%%s, %%eax\n", source);
+            break;
+        case OPERATION_MUL:
+            emit("\timull\t%%%s, %%eax\n", source);
+            break;
+        case OPERATION_DIV:
+            label = next_label++;
+            emit("\ttestl\t%%%s, %%%s\n", source, source);
+            emit("\tje\t.Lscc_div_zero_%d\n", label);
+            emit("\txorl\t%%edx, %%edx\n");
+            emit("\tdivl\t%%%s\n", source);
+            emit("\tjmp\t.Lscc_div_done_%d\n", label);
+            emit(".Lscc_div_zero_%d:\n", label);
+            emit("\txorl\t%%eax, %%eax\n");
+            emit(".Lscc_div_done_%d:\n", label);
+            break;
+    }
+}
+
+/**
+ * @brief Writes a string for .string, a % in a name is escaped for printf
+ *
+ */
+static void
+write_format_name(const char *name)
+{
+    for(const char *c = name; *c != '\0'; c++)
+    {
+        if(*c == '%') fputs("%%", x86_fd);
+        else if(*c == '"' || *c == '\\') fprintf(x86_fd, "\\%c", *c);
+        else fputc(*c, x86_fd);
+    }
+}
+
+static void
+x86_open(const char *filename, struct backend_options *options)
+{
+    x86_fd = fopen(filename, "w");
+    if(x86_fd == NULL) fatal_error("x86-64 output file %s failed to open\n", filename);
+    step_limit = options->step_limit;
+    fprintf(x86_fd, "# Written by SCC, build with: cc %s\n", filename);
+}
+
+/**
+ * @brief Writes where the program ends up: every var is printed, then
+ *        the step limit message if a -1 loop stopped, then main returns
+ *
+ */
+static void
+x86_close()
+{
+    if(x86_fd == NULL) return;
+
+    emit("\n.Lscc_exit:\n");
+    emit("\tmovq\t%%rbp, %%rsp\n");
+    emit("\tpushq\t%%rbx\n");
+    emit("\tpushq\t%%r12\n");
+    for(int i = 0; i < report_var_count; i++)
+    {
+        struct operand *var = &report_vars[i];
+
+        emit("\tleaq\t.Lscc_format_%d(%%rip), %%rdi\n", i);
+        if(var->kind == OPERAND_VAR)
+        {
+            emit("\tmovzwl\tscc_data+%d(%%rip), %%esi\n", 2 * var->addr);
+            emit("\txorl\t%%eax, %%eax\n");
+            emit("\tcall\tprintf@PLT\n");
+            continue;
+        }
+        emit("\txorl\t%%eax, %%eax\n");
+        emit("\tcall\tprintf@PLT\n");
+        emit("\tleaq\tscc_data+%d(%%rip), %%rbx\n", 2 * var->addr);
+        emit("\tmovl\t$%d, %%r12d\n", var->length);
+        emit(".Lscc_print_%d:\n", i);
+        emit("\tleaq\t.Lscc_format_element(%%rip), %%rdi\n");
+        emit("\tmovzwl\t(%%rbx), %%esi\n");
+        emit("\txorl\t%%eax, %%eax\n");
+        emit("\tcall\tprintf@PLT\n");
+        emit("\taddq\t$2, %%rbx\n");
+        emit("\tdecl\t%%r12d\n");
+        emit("\tjnz\t.Lscc_print_%d\n", i);
+        emit("\tmovl\t$10, %%edi\n");
+        emit("\tcall\tputchar@PLT\n");
+    }
+    emit("\tmovl\tscc_stopped_line(%%rip), %%edx\n");
+    emit("\ttestl\t%%edx, %%edx\n");
+    emit("\tje\t.Lscc_return\n");
+    emit("\tleaq\t.Lscc_format_step_limit(%%rip), %%rdi\n");
+    emit("\tmovabsq\t$%ld, %%rsi\n", step_limit);
+    emit("\txorl\t%%eax, %%eax\n");
+    emit("\tcall\tprintf@PLT\n");
+    emit(".Lscc_return:\n");
+    emit("\tpopq\t%%r12\n");
+    emit("\tpopq\t%%rbx\n");
+    emit("\txorl\t%%eax, %%eax\n");
+    emit("\tpopq\t%%rbp\n");
+    emit("\tret\n");
+
+    fprintf(x86_fd, "\n\t.section .rodata\n");
+    for(int i = 0; i < report_var_count; i++)
+    {
+        fprintf(x86_fd, ".Lscc_format_%d:\n\t.string \"", i);
+        write_format_name(report_vars[i].name);
+        fprintf(x86_fd, (report_vars[i].kind == OPERAND_VAR) ? " = %%u\\n\"\n" : " =\"\n");
+    }
+    fprintf(x86_fd, ".Lscc_format_element:\n\t.string \" %%u\"\n");
+    fprintf(x86_fd, ".Lscc_format_step_limit:\n"
+                    "\t.string \"Step limit of %%ld reached in the loop on line: %%d\\n\"\n");
+
+    fprintf(x86_fd, "\n\t.bss\n");
+    fprintf(x86_fd, "\t.align 16\n");
+    fprintf(x86_fd, "scc_data:\n\t.zero %d\n", 2 * X86_DATA_WORDS);
+    fprintf(x86_fd, "scc_passes:\n\t.zero 8\n");
+    fprintf(x86_fd, "scc_stopped_line:\n\t.zero 4\n");
+    fprintf(x86_fd, "\n\t.section .note.GNU-stack,\"\",@progbits\n");
+
+    fclose(x86_fd);
+    x86_fd = NULL;
+    free(report_vars);
+    report_vars = NULL;
+    report_var_count = 0;
+}
+
+static void
+x86_code_begin(int prog_memory_start)
+{
+    //The assembler places the code
+    (void)prog_memory_start;
+    fprintf(x86_fd, "\n\t.text\n");
+    fprintf(x86_fd, "\t.globl\tmain\n");
+    fprintf(x86_fd, "\t.type\tmain, @function\n");
+    emit("main:\n");
+    emit("\tpushq\t%%rbp\n");
+    emit("\tmovq\t%%rsp, %%rbp\n");
+}
+
+static int
+x86_addr()
+{
+    return instruction_count;
+}
+
+static void
+x86_comment(const char *text)
+{
+    fprintf(x86_fd, "\n# %s\n", text);
+}
+
+static void
+x86_declare_var(struct operand *var, int value)
+{
+    char reference[64];
+
+    operand_reference(var, reference, sizeof(reference));
+    emit("\tmovw\t$%d, %s\t# %s\n", value & 0xFFFF, reference, var->name);
+}
+
+static void
+x86_assign(struct operand *dest, struct operand *source)
+{
+    load_operand("eax", source);
+    store_result(dest);
+}
+
+static void
+x86_operate(struct operand *dest, struct operand *source1,
+            enum OPERATIONS operation, struct operand *source2)
+{
+    load_operand("eax", source1);
+    load_operand("esi", source2);
+    write_operation(operation, "esi");
+    store_result(dest);
+}
+
+/**
+ * @brief One native loop over the elements: dest in %r8, array sources in
+ *        %r9 and %r10, a source that is not an array is loaded once into
+ *        %edi or %esi. The unroll from the profile is for SAMCO, the
+ *        native loop is already short.
+ *
+ */
+static void
+x86_array_statement(struct operand *dest, struct operand *source1,
+                    enum OPERATIONS operation, struct operand *source2,
+                    int unroll)
+{
+    //One element per pass, unrolling is for SAMCO program memory
+    (void)unroll;
+    int label = next_label++;
+    int source2_used = (operation != OPERATION_NONE);
+
+    if(source1->kind != OPERAND_ARRAY) load_operand("edi", source1);
+    else emit("\tleaq\tscc_data+%d(%%rip), %%r9\t# %s\n", 2 * source1->addr, source1->name);
+    if(source2_used)
+    {
+        if(source2->kind != OPERAND_ARRAY) load_operand("esi", source2);
+        else emit("\tleaq\tscc_data+%d(%%rip), %%r10\t# %s\n", 2 * source2->addr, source2->name);
+    }
+    emit("\tleaq\tscc_data+%d(%%rip), %%r8\t# %s\n", 2 * dest->addr, dest->name);
+    emit("\tmovl\t$%d, %%ecx\n", dest->length);
+
+    emit(".Lscc_array_%d:\n", label);
+    if(source1->kind == OPERAND_ARRAY) emit("\tmovzwl\t(%%r9), %%eax\n");
+    else emit("\tmovl\t%%edi, %%eax\n");
+    if(source2_used)
+    {
+        if(source2->kind == OPERAND_ARRAY) emit("\tmovzwl\t(%%r10), %%r11d\n");
+        else emit("\tmovl\t%%esi, %%r11d\n");
+        write_operation(operation, "r11d");
+    }
+    emit("\tmovw\t%%ax, (%%r8)\n");
+    emit("\taddq\t$2, %%r8\n");
+    if(source1->kind == OPERAND_ARRAY) emit("\taddq\t$2, %%r9\n");
+    if(source2_used && source2->kind == OPERAND_ARRAY) emit("\taddq\t$2, %%r10\n");
+    emit("\tdecl\t%%ecx\n");
+    emit("\tjnz\t.Lscc_array_%d\n", label);
+}
+
+/**
+ * @brief A loop of 0 is skipped, -1 loops until the step limit, any other
+ *        amount is taken as 16 bit
+ *
+ */
+static void
+x86_loop_begin(int amount, struct operand *counter)
+{
+    //The count is kept on the stack instead
+    (void)counter;
+    if(loop_depth >= MAX_NESTED_BLOCKS) fatal_error("Loops nested too deep\n");
+
+    struct x86_loop *loop = &loop_stack[loop_depth++];
+    loop->label = next_label++;
+    loop->forever = (amount == -1);
+
+    if(!loop->forever)
+    {
+        emit("\tpushq\t$%d\n", amount & 0xFFFF);
+        if((amount & 0xFFFF) == 0) emit("\tjmp\t.Lscc_loop_exit_%d\n", loop->label);
+    }
+    emit(".Lscc_loop_%d:\n", loop->label);
+}
+
+static void
+x86_loop_end(int line)
+{
+    struct x86_loop *loop = &loop_stack[--loop_depth];
+
+    if(loop->forever)
+    {
+        emit("\tincq\tscc_passes(%%rip)\n");
+        emit("\tmovabsq\t$%ld, %%rax\n", step_limit);
+        emit("\tcmpq\t%%rax, scc_passes(%%rip)\n");
+        emit("\tjb\t.Lscc_loop_%d\n", loop->label);
+        emit("\tmovl\t$%d, scc_stopped_line(%%rip)\n", line);
+        emit("\tjmp\t.Lscc_exit\n");
+        return;
+    }
+    emit("\tdecq\t(%%rsp)\n");
+    emit("\tjnz\t.Lscc_loop_%d\n", loop->label);
+    emit(".Lscc_loop_exit_%d:\n", loop->label);
+    emit("\taddq\t$8, %%rsp\n");
+}
+
+static void
+x86_if_begin(struct operand *var, int value)
+{
+    int label = next_label++;
+
+    if_label_stack[if_depth++] = label;
+    load_operand("eax", var);
+    emit("\tcmpl\t$%d, %%eax\n", value & 0xFFFF);
+    emit("\tjne\t.Lscc_if_end_%d\n", label);
+}
+
+static void
+x86_if_end()
+{
+    emit(".Lscc_if_end_%d:\n", if_label_stack[--if_depth]);
+}
+
+/**
+ * @brief Like x86_if_begin but equal jumps to the body written after the
+ *        program, so not equal falls straight through
+ *
+ * @return cold if to pass to x86_cold_body_begin and x86_cold_body_end
+ *
+ */
+static int
+x86_cold_if_begin(struct operand *var, int value)
+{
+    int label = next_label++;
+
+    load_operand("eax", var);
+    emit("\tcmpl\t$%d, %%eax\n", value & 0xFFFF);
+    emit("\tje\t.Lscc_cold_%d\n", label);
+    emit(".Lscc_back_%d:\n", label);
+    return label;
+}
+
+static void
+x86_program_end()
+{
+    emit("\tjmp\t.Lscc_exit\n");
+}
+
+static void
+x86_cold_body_begin(int cold_if)
+{
+    emit(".Lscc_cold_%d:\n", cold_if);
+}
+
+static void
+x86_cold_body_end(int cold_if)
+{
+    emit("\tjmp\t.Lscc_back_%d\n", cold_if);
+}
+
+/**
+ * @brief The proc is jumped over and only runs through call, the return
+ *        addr is on the stack so the return slot is not used
+ *
+ */
+static void
+x86_proc_begin(struct proc *proc, struct operand *return_slot)
+{
+    //call and ret keep the return addr on the stack
+    (void)return_slot;
+    emit("\tjmp\t.Lscc_skip_%s\n", proc->name);
+    emit(".Lscc_proc_%s:\n", proc->name);
+}
+
+static void
+x86_proc_end(struct proc *proc, struct operand *return_slot)
+{
+    (void)return_slot;
+    emit("\tret\n");
+    emit(".Lscc_skip_%s:\n", proc->name);
+}
+
+static void
+x86_call(struct proc *proc)
+{
+    emit("\tcall\t.Lscc_proc_%s\n", proc->name);
+}
+
+static void
+x86_report_var(struct operand *var)
+{
+    report_vars = realloc(report_vars, (report_var_count + 1) * sizeof(*report_vars));
+    if(report_vars == NULL) fatal_error("Out of memory\n");
+    report_vars[report_var_count++] = *var;
+}
+
+struct backend x86_64_backend =
+{
+    .name = "x86_64",
+    .program_addrs = 0,
+    .open = x86_open,
+    .close = x86_close,
+    .code_begin = x86_code_begin,
+    .addr = x86_addr,
+    .comment = x86_comment,
+    .declare_var = x86_declare_var,
+    .assign = x86_assign,
+    .operate = x86_operate,
+    .array_statement = x86_array_statement,
+    .loop_begin = x86_loop_begin,
+    .loop_end = x86_loop_end,
+    .if_begin = x86_if_begin,
+    .if_end = x86_if_end,
+    .cold_if_begin = x86_cold_if_begin,
+    .program_end = x86_program_end,
+    .cold_body_begin = x86_cold_body_begin,
+    .cold_body_end = x86_cold_body_end,
+    .proc_begin = x86_proc_begin,
+    .proc_end = x86_proc_end,
+    .call = x86_call,
+    .report_var = x86_report_var
+};
+
+/* End of file: backend_x86_64.c */
@@ -0,0 +1,351 @@
+/*
+ * File name: data_layout.c
+ * Description: Decides where each var goes in data memory before the code
+ *              is compiled.
+ *
+ * Notes:
+ *      A var is as hot as the number of lines that use it, or with
+ *      --profile-use the sum of the counts of those lines. Vars used on
+ *      the same lines are kept next to each other, hottest group first.
+ *
+ *      Loading a value into a register takes one lshf instead of two when
+ *      the low byte of the register is the high byte of the value. An if
+ *      loads the var addr into r1 and then the compare value, so a var
+ *      compared with a value below 256 is cheapest at the start of a 256
+ *      word page. Those vars get page starts when the addr is known, not
+ *      with -c where SCC-link decides it.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "../include/errors.h"
+#include "../include/scc.h"
+#include "../include/profile.h"
+#include "../include/data_layout.h"
+
+#define PAGE_SIZE           256
+
+static struct layout_var *vars;
+static int var_count = 0;
+static long *affinity;      //var_count * var_count lines used together
+static int planned_size = 0;
+static int planned_words = 0;
+
+static struct layout_var *
+find_var(const char *name)
+{
+    for(int i = 0; i < var_count; i++)
+    {
+        if(strcmp(vars[i].name, name) == 0) return &vars[i];
+    }
+    return NULL;
+}
+
+/**
+ * @brief Adds weight to every declared var named on line and to the
+ *        affinity of each pair of them
+ *
+ */
+static void
+count_uses(char *line, long weight)
+{
+    char buffer[MAX_LINE_SIZE_CHAR];
+    int used[MAX_OPERATION_ARGS * 2];
+    int used_count = 0;
+    strcpy(buffer, line);
+
+    char *column_0 = strtok(buffer, " []");
+    for(char *token = column_0; token != NULL; token = strtok(NULL, " []"))
+    {
+        struct layout_var *var = find_var(token);
+        if(var == NULL) continue;
+        var->weight = var->weight + weight;
+
+        int index = var - vars;
+        int seen = 0;
+        for(int i = 0; i < used_count; i++) if(used[i] == index) seen = 1;
+        if(!seen && used_count < MAX_OPERATION_ARGS * 2) used[used_count++] = index;
+    }
+
+    for(int i = 0; i < used_count; i++)
+    {
+        for(int j = 0; j < used_count; j++)
+        {
+            if(i != j) affinity[used[i] * var_count + used[j]] += weight;
+        }
+    }
+
+    //if <name> == <value> loads a value below 256 after the addr
+    strcpy(buffer, line);
+    column_0 = strtok(buffer, " ");
+    char *name = strtok(NULL, " ");
+    strtok(NULL, " ");
+    char *value = strtok(NULL, " ");
+    if(column_0 != NULL && strcmp(column_0, "if") == 0 && name != NULL
+       && value != NULL && atoi(value) >= 0 && atoi(value) < PAGE_SIZE)
+    {
+        struct layout_var *var = find_var(name);
+        if(var != NULL && var->length == 1) var->compares = var->compares + weight;
+    }
+}
+
+/**
+ * @brief Reads the var declarations and uses of the whole .scc file.
+ *        Leaves scc_fd rewound.
+ *
+ * @param scc_fd open .scc input
+ *
+ */
+void
+data_layout_scan(FILE *scc_fd)
+{
+    char line_buffer[MAX_LINE_SIZE_CHAR];
+    char column_buffer[MAX_LINE_SIZE_CHAR];
+    long *line_weights = NULL;
+    char **lines = NULL;
+    int line_count = 0;
+    int in_code = 0;
+
+    for(int line_index = 1; fgets(line_buffer, sizeof(line_buffer), scc_fd) != NULL; line_index++)
+    {
+        char *newline = strchr(line_buffer, '\n');
+        if(newline) *newline = '\0';
+
+        strcpy(column_buffer, line_buffer);
+        char *column_0 = strtok(column_buffer, " ");
+        if(column_0 == NULL) continue;
+        if(!in_code)
+        {
+            if(strcmp(column_0, "CODE_BEGIN") == 0) in_code = 1;
+            continue;
+        }
+        if(strcmp(column_0, "CODE_END") == 0) break;
+        if(strcmp(column_0, "//") == 0) continue;
+
+        lines = realloc(lines, (line_count + 1) * sizeof(char *));
+        line_weights = realloc(line_weights, (line_count + 1) * sizeof(long));
+        if(lines == NULL || line_weights == NULL) fatal_error("Out of memory\n");
+        lines[line_count] = strdup(line_buffer);
+        if(lines[line_count] == NULL) fatal_error("Out of memory\n");
+        line_weights[line_count] = profile_loaded() ? profile_line_count(line_index) : 1;
+        line_count++;
+
+        char *declaration = strtok(NULL, " ");
+        if(strcmp(column_0, "var") != 0 || declaration == NULL) continue;
+
+        int length = 1;
+        char *open = strchr(declaration, '[');
+        if(open != NULL)
+        {
+            length = atoi(open + 1);
+            *open = '\0';
+        }
+        if(strlen(declaration) >= MAX_LAYOUT_NAME) fatal_error("var name too long: %s\n", declaration);
+        //A second declaration uses the first one's storage
+        if(find_var(declaration) != NULL || length < 1) continue;
+
+        vars = realloc(vars, (var_count + 1) * sizeof(*vars));
+        if(vars == NULL) fatal_error("Out of memory\n");
+        memset(&vars[var_count], 0, sizeof(*vars));
+        strcpy(vars[var_count].name, declaration);
+        vars[var_count].length = length;
+        vars[var_count].order = var_count;
+        vars[var_count].offset = -1;
+        var_count++;
+    }
+
+    affinity = calloc((size_t)var_count * var_count + 1, sizeof(long));
+    if(affinity == NULL) fatal_error("Out of memory\n");
+    for(int i = 0; i < line_count; i++)
+    {
+        count_uses(lines[i], line_weights[i]);
+        free(lines[i]);
+    }
+    free(lines);
+    free(line_weights);
+
+    rewind(scc_fd);
+}
+
+static int
+hotter(struct layout_var *a, struct layout_var *b)
+{
+    if(a->weight != b->weight) return a->weight > b->weight;
+    return a->order < b->order;
+}
+
+/**
+ * @brief Orders vars into groups: the hottest var not placed yet, then
+ *        the vars most used together with the group so far
+ *
+ * @param order filled with var indexes
+ *
+ */
+static void
+group_vars(int *order)
+{
+    int *taken = calloc(var_count + 1, sizeof(int));
+    if(taken == NULL) fatal_error("Out of memory\n");
+
+    int placed = 0;
+    int group_start = 0;
+    while(placed < var_count)
+    {
+        int best = -1;
+        long best_affinity = 0;
+        for(int i = 0; i < var_count; i++)
+        {
+            if(taken[i]) continue;
+            long together = 0;
+            for(int j = group_start; j < placed; j++)
+            {
+                together = together + affinity[order[j] * var_count + i];
+            }
+            if(together > best_affinity
+               || (together == best_affinity && (best == -1 || hotter(&vars[i], &vars[best]))))
+            {
+                best = i;
+                best_affinity = together;
+            }
+        }
+        //Nothing left is used with this group, start the next one
+        if(best_affinity == 0) group_start = placed;
+        taken[best] = 1;
+        order[placed++] = best;
+    }
+    free(taken);
+}
+
+/**
+ * @brief First free run of length words in used, or -1
+ *
+ */
+static int
+first_fit(char *used, int size, int length)
+{
+    int run = 0;
+    for(int i = 0; i < size; i++)
+    {
+        run = used[i] ? 0 : run + 1;
+        if(run == length) return i - length + 1;
+    }
+    return -1;
+}
+
+/**
+ * @brief Gives every declared var an addr in [start, end]
+ *
+ * @param start first addr vars may use, the middle of data memory like
+ *              SCC has always placed vars, 0 with -c
+ * @param end last addr vars may use
+ * @param addr_known 0 with -c, the module is placed by SCC-link so page
+ *                   starts are not known
+ *
+ */
+void
+data_layout_place(int start, int end, int addr_known)
+{
+    int size = end - start + 1;
+    int *order = malloc((var_count + 1) * sizeof(int));
+    char *used = calloc((size > 0) ? size : 1, 1);
+    if(order == NULL || used == NULL) fatal_error("Out of memory\n");
+    group_vars(order);
+
+    int words = 0;
+    for(int i = 0; i < var_count; i++) words = words + vars[i].length;
+    if(words > size)
+    {
+        fatal_error("vars need %d words, only %d fit from %d to DATA_MEMORY_END %d\n",
+                    words, (size > 0) ? size : 0, start, end);
+    }
+
+    //Page starts are only handed out while every var still fits in one
+    //run after them
+    if(addr_known)
+    {
+        int first_page = ((start + PAGE_SIZE - 1) / PAGE_SIZE) * PAGE_SIZE - start;
+        int pages_used = 0;
+        for(int i = 0; i < var_count; i++)
+        {
+            struct layout_var *var = &vars[order[i]];
+            int slot = first_page + pages_used * PAGE_SIZE;
+            if(var->compares == 0) continue;
+            if(slot + 1 + words > size) break;
+
+            var->offset = slot;
+            used[slot] = 1;
+            pages_used++;
+        }
+    }
+
+    for(int i = 0; i < var_count; i++)
+    {
+        struct layout_var *var = &vars[order[i]];
+        if(var->offset >= 0) continue;
+        var->offset = first_fit(used, size, var->length);
+        if(var->offset < 0)
+        {
+            fatal_error("No room for var %s in data memory, DATA_MEMORY_END is %d\n",
+                        var->name, end);
+        }
+        memset(used + var->offset, 1, var->length);
+    }
+
+    for(int i = 0; i < var_count; i++)
+    {
+        int var_end = vars[i].offset + vars[i].length;
+        if(var_end > planned_size) planned_size = var_end;
+    }
+    planned_words = words;
+
+    free(order);
+    free(used);
+}
+
+/**
+ * @brief Planned offset of var from VAR_MEMORY_START
+ *
+ * @return -1 if the var was not planned
+ *
+ */
+int
+data_layout_offset(const char *name)
+{
+    struct layout_var *var = find_var(name);
+    return (var == NULL) ? -1 : var->offset;
+}
+
+/**
+ * @brief Words from VAR_MEMORY_START to the end of the last planned var
+ *
+ */
+int
+data_layout_size()
+{
+    return planned_size;
+}
+
+/**
+ * @brief Words the planned vars take, not counting gaps
+ *
+ */
+int
+data_layout_words()
+{
+    return planned_words;
+}
+
+/**
+ * @brief Uses of var counted for the layout, -1 if it was not planned
+ *
+ */
+long
+data_layout_uses(const char *name)
+{
+    struct layout_var *var = find_var(name);
+    return (var == NULL) ? -1 : var->weight;
+}
+
+/* End of file: data_layout.c */
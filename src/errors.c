@@ -10,6 +10,8 @@
 #include <string.h>
 #include <stdlib.h>
 
+#include "../include/errors.h"
+
 void
 fatal_error(const char *format, ...)
 {
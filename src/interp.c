@@ -0,0 +1,199 @@
+/*
+ * File name: interp.c
+ * Description: Runs the bytecode from backend_bytecode.c on the host for
+ *              --run.
+ *
+ * Notes:
+ *      With gcc or clang every instruction holds the addr of its handler
+ *      and each handler jumps straight to the next one (direct threading),
+ *      other compilers get a switch. Values are 16 bit and wrap like the
+ *      SAMCO registers do, dividing by 0 gives 0.
+ *
+ *      Only a -1 loop can run forever so only its jump back checks the
+ *      step limit. The limit counts passes through -1 loops, like the
+ *      x86_64 backend does, not instructions.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "../include/errors.h"
+#include "../include/procs.h"
+#include "../include/bytecode.h"
+#include "../include/interp.h"
+
+#if defined(__GNUC__)
+#define INTERP_DIRECT_THREADED
+#endif
+
+#ifdef INTERP_DIRECT_THREADED
+#define HANDLER(opcode)     handle_##opcode:
+#define DISPATCH()          goto *ip->handler
+#else
+#define HANDLER(opcode)     case opcode:
+#define DISPATCH()          continue
+#endif
+
+//Not wrapped in do while, continue has to reach the switch loop
+#define NEXT()              { ip++; steps++; DISPATCH(); }
+#define JUMP(to)            { ip = code + (to); steps++; DISPATCH(); }
+
+//dst[i] = a[i * a_step] <op> b[i * b_step] for every element
+#define ARRAY_LOOP(expression)                                          \
+    {                                                                   \
+        uint16_t *dst = memory + ip->dst;                               \
+        uint16_t *a = memory + ip->a;                                   \
+        uint16_t *b = memory + ip->b;                                   \
+        for(int i = 0; i < ip->count; i++)                              \
+        {                                                               \
+            dst[i] = (uint16_t)(expression);                            \
+            a = a + ip->a_step;                                         \
+            b = b + ip->b_step;                                         \
+        }                                                               \
+    }
+
+/**
+ * @brief Runs program until its end or until -1 loops have made
+ *        step_limit passes between them. Vars are left in program->memory.
+ *
+ */
+void
+interp_run(struct bytecode_program *program, long step_limit,
+           struct interp_result *result)
+{
+    uint16_t *memory = program->memory;
+    struct bytecode_instruction *code = program->code;
+    struct bytecode_instruction *ip = code;
+    struct bytecode_instruction *return_stack[MAX_PROCS];
+    int return_depth = 0;
+    long steps = 0;
+    long passes = 0;
+
+    result->stopped_line = 0;
+
+#ifdef INTERP_DIRECT_THREADED
+    static const void *handlers[BC_OPCODE_COUNT] =
+    {
+        [BC_SET] = &&handle_BC_SET,
+        [BC_MOVE] = &&handle_BC_MOVE,
+        [BC_ADD] = &&handle_BC_ADD,
+        [BC_SUB] = &&handle_BC_SUB,
+        [BC_MUL] = &&handle_BC_MUL,
+        [BC_DIV] = &&handle_BC_DIV,
+        [BC_LOAD_ELEMENT] = &&handle_BC_LOAD_ELEMENT,
+        [BC_STORE_ELEMENT] = &&handle_BC_STORE_ELEMENT,
+        [BC_ARRAY_MOVE] = &&handle_BC_ARRAY_MOVE,
+        [BC_ARRAY_ADD] = &&handle_BC_ARRAY_ADD,
+        [BC_ARRAY_SUB] = &&handle_BC_ARRAY_SUB,
+        [BC_ARRAY_MUL] = &&handle_BC_ARRAY_MUL,
+        [BC_ARRAY_DIV] = &&handle_BC_ARRAY_DIV,
+        [BC_IF_NOT_EQUAL] = &&handle_BC_IF_NOT_EQUAL,
+        [BC_IF_EQUAL] = &&handle_BC_IF_EQUAL,
+        [BC_LOOP_BEGIN] = &&handle_BC_LOOP_BEGIN,
+        [BC_LOOP_END] = &&handle_BC_LOOP_END,
+        [BC_LOOP_FOREVER] = &&handle_BC_LOOP_FOREVER,
+        [BC_JUMP] = &&handle_BC_JUMP,
+        [BC_CALL] = &&handle_BC_CALL,
+        [BC_RETURN] = &&handle_BC_RETURN,
+        [BC_END] = &&handle_BC_END
+    };
+    for(int i = 0; i < program->code_count; i++)
+    {
+        code[i].handler = handlers[code[i].opcode];
+    }
+    DISPATCH();
+#else
+    for(;;) switch(ip->opcode)
+    {
+#endif
+
+    HANDLER(BC_SET)
+        memory[ip->dst] = (uint16_t)ip->a;
+        NEXT();
+    HANDLER(BC_MOVE)
+        memory[ip->dst] = memory[ip->a];
+        NEXT();
+    HANDLER(BC_ADD)
+        memory[ip->dst] = (uint16_t)(memory[ip->a] + memory[ip->b]);
+        NEXT();
+    HANDLER(BC_SUB)
+        memory[ip->dst] = (uint16_t)(memory[ip->a] - memory[ip->b]);
+        NEXT();
+    HANDLER(BC_MUL)
+        memory[ip->dst] = (uint16_t)((uint32_t)memory[ip->a] * memory[ip->b]);
+        NEXT();
+    HANDLER(BC_DIV)
+        memory[ip->dst] = memory[ip->b] ? memory[ip->a] / memory[ip->b] : 0;
+        NEXT();
+
+    HANDLER(BC_LOAD_ELEMENT)
+        memory[ip->dst] = memory[(ip->a + memory[ip->b]) & 0xFFFF];
+        NEXT();
+    HANDLER(BC_STORE_ELEMENT)
+        memory[(ip->dst + memory[ip->b]) & 0xFFFF] = memory[ip->a];
+        NEXT();
+
+    HANDLER(BC_ARRAY_MOVE)
+        ARRAY_LOOP(*a);
+        NEXT();
+    HANDLER(BC_ARRAY_ADD)
+        ARRAY_LOOP(*a + *b);
+        NEXT();
+    HANDLER(BC_ARRAY_SUB)
+        ARRAY_LOOP(*a - *b);
+        NEXT();
+    HANDLER(BC_ARRAY_MUL)
+        ARRAY_LOOP((uint32_t)*a * *b);
+        NEXT();
+    HANDLER(BC_ARRAY_DIV)
+        ARRAY_LOOP(*b ? *a / *b : 0);
+        NEXT();
+
+    HANDLER(BC_IF_NOT_EQUAL)
+        if(memory[ip->a] != ip->b) JUMP(ip->target);
+        NEXT();
+    HANDLER(BC_IF_EQUAL)
+        if(memory[ip->a] == ip->b) JUMP(ip->target);
+        NEXT();
+    HANDLER(BC_LOOP_BEGIN)
+        memory[ip->dst] = (uint16_t)ip->a;
+        if(ip->a == 0) JUMP(ip->target);
+        NEXT();
+    HANDLER(BC_LOOP_END)
+        if(--memory[ip->dst] != 0) JUMP(ip->target);
+        NEXT();
+    HANDLER(BC_LOOP_FOREVER)
+        if(++passes >= step_limit)
+        {
+            result->stopped_line = ip->line;
+            goto done;
+        }
+        JUMP(ip->target);
+
+    HANDLER(BC_JUMP)
+        JUMP(ip->target);
+    HANDLER(BC_CALL)
+        if(return_depth >= MAX_PROCS) fatal_error("Calls nested too deep\n");
+        return_stack[return_depth++] = ip + 1;
+        JUMP(ip->target);
+    HANDLER(BC_RETURN)
+        ip = return_stack[--return_depth];
+        steps++;
+        DISPATCH();
+
+    HANDLER(BC_END)
+        goto done;
+
+#ifndef INTERP_DIRECT_THREADED
+    default:
+        fatal_error("Bad bytecode %d\n", ip->opcode);
+    }
+#endif
+
+done:
+    result->steps = steps;
+}
+
+/* End of file: interp.c */
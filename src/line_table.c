@@ -0,0 +1,80 @@
+/*
+ * File name: line_table.c
+ * Description: Writes the debug line table that maps program address ranges
+ *              back to the .scc line and construct that produced them.
+ *
+ * Notes:
+ *      One entry per line: <start_addr> <end_addr> <source> <line> <construct>
+ *      Addresses are decimal and the range is [start_addr, end_addr).
+ *      Lines starting with // are comments. Lines that emit no instructions
+ *      ({, <, >, comments) get no entry.
+ */
+
+#include <stdio.h>
+
+#include "../include/errors.h"
+#include "../include/line_table.h"
+
+static FILE *line_table_fd;
+static const char *line_table_source;
+
+/**
+ * @brief Opens the line table output file and writes the header
+ *
+ * @param table_filename path of the line table to write
+ * @param source_filename .scc file the entries refer to
+ *
+ */
+void
+line_table_open(const char *table_filename, const char *source_filename)
+{
+    line_table_fd = fopen(table_filename, "w");
+    if(line_table_fd == NULL)
+    {
+        fatal_error("Failed to open line table: %s\n", table_filename);
+    }
+    line_table_source = source_filename;
+
+    fprintf(line_table_fd, "//SCC line table\n");
+    fprintf(line_table_fd, "//start end source line construct\n");
+}
+
+/**
+ * @brief Records that [start_addr, end_addr) was generated by line
+ *
+ */
+void
+line_table_add(int start_addr, int end_addr, int line,
+               enum LINE_CONSTRUCTS construct)
+{
+    if(line_table_fd == NULL) return;
+    if(end_addr <= start_addr) return;
+
+    fprintf(line_table_fd, "%d %d %s %d %s\n", start_addr, end_addr,
+                                               line_table_source, line,
+                                               line_table_construct_name(construct));
+}
+
+void
+line_table_close()
+{
+    if(line_table_fd != NULL) fclose(line_table_fd);
+    line_table_fd = NULL;
+}
+
+const char *
+line_table_construct_name(enum LINE_CONSTRUCTS construct)
+{
+    switch(construct)
+    {
+        case CONSTRUCT_VAR:         return "var";
+        case CONSTRUCT_ASSIGNMENT:  return "assignment";
+        case CONSTRUCT_IF:          return "if";
+        case CONSTRUCT_LOOP:        return "loop";
+        case CONSTRUCT_PROC:        return "proc";
+        case CONSTRUCT_CALL:        return "call";
+        default:                    return "none";
+    }
+}
+
+/* End of file: line_table.c */
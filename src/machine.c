@@ -0,0 +1,121 @@
+/*
+ * File name: machine.c
+ * Description: Target machine description (issue width and per opcode
+ *              latency) read from a .mach file for the scheduler.
+ *
+ * Notes:
+ *      The built in values match samco.mach. Opcodes are not case
+ *      sensitive so GET and get are the same opcode.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+
+#include "../include/errors.h"
+#include "../include/scc.h"
+#include "../include/machine.h"
+
+static int issue_width = 1;
+
+static struct opcode_timing opcodes[MAX_MACHINE_OPCODES] =
+{
+    { "lshf", 1, 0 },
+    { "add",  1, 0 },
+    { "sub",  1, 0 },
+    { "mul",  2, 0 },
+    { "div",  4, 0 },
+    { "get",  1, 2 },
+    { "put",  1, 0 },
+    { "jz",   1, 0 }
+};
+static int opcode_count = 8;
+
+static struct opcode_timing *
+find_opcode(const char *opcode)
+{
+    for(int i = 0; i < opcode_count; i++)
+    {
+        if(strcasecmp(opcodes[i].name, opcode) == 0) return &opcodes[i];
+    }
+    return NULL;
+}
+
+/**
+ * @brief Reads a machine description, replacing the built in values for
+ *        every opcode it lists
+ *
+ * @param filename .mach file
+ * @param required fail if the file does not exist, otherwise keep the
+ *                 built in values
+ *
+ */
+void
+machine_load(const char *filename, int required)
+{
+    char buffer[MAX_LINE_SIZE_CHAR];
+    char name[MAX_OPCODE_NAME];
+    int latency, penalty;
+    int line = 0;
+
+    FILE *machine_fd = fopen(filename, "r");
+    if(machine_fd == NULL)
+    {
+        if(required) fatal_error("Failed to open machine description: %s\n", filename);
+        return;
+    }
+
+    while(fgets(buffer, sizeof(buffer), machine_fd) != NULL)
+    {
+        line++;
+        char *start = buffer;
+        while(isspace((unsigned char)*start)) start++;
+        if(*start == '\0' || strncmp(start, "//", 2) == 0) continue;
+
+        if(sscanf(start, "ISSUE_WIDTH %d", &latency) == 1)
+        {
+            if(latency < 1) fatal_error("%s:%d: ISSUE_WIDTH must be at least 1\n", filename, line);
+            issue_width = latency;
+        }
+        else if(sscanf(start, "%15s %d %d", name, &latency, &penalty) == 3)
+        {
+            if(latency < 1 || penalty < 0)
+            {
+                fatal_error("%s:%d: latency must be at least 1\n", filename, line);
+            }
+            struct opcode_timing *timing = find_opcode(name);
+            if(timing == NULL)
+            {
+                if(opcode_count >= MAX_MACHINE_OPCODES) fatal_error("Too many opcodes in %s\n", filename);
+                timing = &opcodes[opcode_count++];
+                strcpy(timing->name, name);
+            }
+            timing->latency = latency;
+            timing->load_use_penalty = penalty;
+        }
+        else fatal_error("%s:%d: not understood\n", filename, line);
+    }
+    fclose(machine_fd);
+}
+
+int
+machine_issue_width()
+{
+    return issue_width;
+}
+
+/**
+ * @brief Cycles from issuing opcode until an instruction using its result
+ *        can issue
+ *
+ */
+int
+machine_result_delay(const char *opcode)
+{
+    struct opcode_timing *timing = find_opcode(opcode);
+    if(timing == NULL) return 1;
+    return timing->latency + timing->load_use_penalty;
+}
+
+/* End of file: machine.c */
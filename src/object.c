@@ -0,0 +1,394 @@
+/*
+ * File name: object.c
+ * Description: Reads and writes SCC object files (.sco) produced by
+ *              'SCC -c' and consumed by SCC-link.
+ *
+ * Notes:
+ *      The format is line based text:
+ *
+ *      SCCOBJ <version>
+ *      MODULE <name>
+ *      SOURCE <scc filename>
+ *      PROG_MEMORY_START/PROG_MEMORY_END/DATA_MEMORY_START/DATA_MEMORY_END <n>
+ *      CODE_SIZE <instructions>
+ *      DATA_SIZE <words>
+ *      IMPORT <module>                         (one per import)
+ *      SYMBOL <name> <data offset> <value> <length>
+ *                                              (one per var)
+ *      EXTERN <name> <length>                  (one per extern var)
+ *      CODE <n>                                (followed by n samco lines)
+ *      RELOC <code line> <HI|LO> <symbol> <addend>
+ *      LINES <n>                               (followed by n line table
+ *                                               entries, module relative)
+ *      END
+ *
+ *      Relocated bytes are written as 0x00 in CODE and are always the last
+ *      operand on their line. The symbol "." is the module's code base.
+ *      A length is the element count of an array and 0 for a var.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "../include/errors.h"
+#include "../include/scc.h"
+#include "../include/object.h"
+
+void
+object_init(struct object_file *object)
+{
+    memset(object, 0, sizeof(*object));
+}
+
+void
+object_free(struct object_file *object)
+{
+    for(int i = 0; i < object->code_line_count; i++) free(object->code_lines[i]);
+    for(int i = 0; i < object->line_table_count; i++) free(object->line_table[i]);
+    free(object->code_lines);
+    free(object->line_table);
+    free(object->symbols);
+    free(object->externs);
+    free(object->relocations);
+    object_init(object);
+}
+
+static void
+copy_name(char *dest, const char *src)
+{
+    if(strlen(src) >= MAX_SYMBOL_NAME) fatal_error("Name too long: %s\n", src);
+    strcpy(dest, src);
+}
+
+void
+object_add_import(struct object_file *object, const char *module)
+{
+    if(object->import_count >= MAX_IMPORTS) fatal_error("Too many imports\n");
+    copy_name(object->imports[object->import_count++], module);
+}
+
+void
+object_add_symbol(struct object_file *object, const char *name,
+                  int offset, int value, int length)
+{
+    object->symbols = realloc(object->symbols, (object->symbol_count + 1)
+                                               * sizeof(*object->symbols));
+    if(object->symbols == NULL) fatal_error("Out of memory\n");
+
+    struct object_symbol *symbol = &object->symbols[object->symbol_count++];
+    copy_name(symbol->name, name);
+    symbol->offset = offset;
+    symbol->value = value;
+    symbol->length = length;
+}
+
+void
+object_add_extern(struct object_file *object, const char *name, int length)
+{
+    object->externs = realloc(object->externs, (object->extern_count + 1)
+                                               * sizeof(*object->externs));
+    if(object->externs == NULL) fatal_error("Out of memory\n");
+
+    struct object_extern *extern_var = &object->externs[object->extern_count++];
+    copy_name(extern_var->name, name);
+    extern_var->length = length;
+}
+
+static void
+add_relocation(struct object_file *object, enum RELOCATION_BYTES byte,
+               const char *symbol, int addend)
+{
+    object->relocations = realloc(object->relocations,
+                                  (object->relocation_count + 1)
+                                  * sizeof(*object->relocations));
+    if(object->relocations == NULL) fatal_error("Out of memory\n");
+
+    struct object_relocation *reloc =
+        &object->relocations[object->relocation_count++];
+    reloc->code_line = object->code_line_count;
+    reloc->byte = byte;
+    copy_name(reloc->symbol, symbol);
+    reloc->addend = addend;
+}
+
+static char **
+append_line(char **lines, int *count, const char *line)
+{
+    lines = realloc(lines, (*count + 1) * sizeof(*lines));
+    if(lines == NULL) fatal_error("Out of memory\n");
+    lines[*count] = strdup(line);
+    if(lines[*count] == NULL) fatal_error("Out of memory\n");
+    (*count)++;
+    return lines;
+}
+
+/**
+ * @brief Adds a line of samco code. A trailing %hi(sym+addend) or
+ *        %lo(sym+addend) operand becomes a relocation and is replaced
+ *        with 0x00.
+ *
+ * @param line samco line without the newline
+ *
+ */
+void
+object_add_code_line(struct object_file *object, const char *line)
+{
+    char buffer[MAX_LINE_SIZE_CHAR];
+    strncpy(buffer, line, sizeof(buffer) - 1);
+    buffer[sizeof(buffer) - 1] = '\0';
+
+    enum RELOCATION_BYTES byte = RELOC_HI;
+    char *marker = strstr(buffer, "%hi(");
+    if(marker == NULL)
+    {
+        marker = strstr(buffer, "%lo(");
+        byte = RELOC_LO;
+    }
+
+    if(marker != NULL)
+    {
+        char *symbol = marker + 4;
+        char *plus = strrchr(symbol, '+');
+        char *close = strchr(symbol, ')');
+        if(plus == NULL || close == NULL || plus > close)
+        {
+            fatal_error("Malformed relocation: %s\n", line);
+        }
+        *plus = '\0';
+        *close = '\0';
+        add_relocation(object, byte, symbol, atoi(plus + 1));
+        strcpy(marker, "0x00");
+    }
+
+    object->code_lines = append_line(object->code_lines,
+                                     &object->code_line_count, buffer);
+}
+
+void
+object_add_line_table_entry(struct object_file *object, const char *entry)
+{
+    object->line_table = append_line(object->line_table,
+                                     &object->line_table_count, entry);
+}
+
+void
+object_write(const char *filename, struct object_file *object)
+{
+    FILE *object_fd = fopen(filename, "w");
+    if(object_fd == NULL) fatal_error("Failed to open object file: %s\n", filename);
+
+    fprintf(object_fd, "SCCOBJ %d\n", OBJECT_FORMAT_VERSION);
+    fprintf(object_fd, "MODULE %s\n", object->module);
+    fprintf(object_fd, "SOURCE %s\n", object->source);
+    fprintf(object_fd, "PROG_MEMORY_START %d\n", object->prog_memory_start);
+    fprintf(object_fd, "PROG_MEMORY_END %d\n", object->prog_memory_end);
+    fprintf(object_fd, "DATA_MEMORY_START %d\n", object->data_memory_start);
+    fprintf(object_fd, "DATA_MEMORY_END %d\n", object->data_memory_end);
+    fprintf(object_fd, "CODE_SIZE %d\n", object->code_size);
+    fprintf(object_fd, "DATA_SIZE %d\n", object->data_size);
+
+    for(int i = 0; i < object->import_count; i++)
+    {
+        fprintf(object_fd, "IMPORT %s\n", object->imports[i]);
+    }
+    for(int i = 0; i < object->symbol_count; i++)
+    {
+        fprintf(object_fd, "SYMBOL %s %d %d %d\n", object->symbols[i].name,
+                                                  object->symbols[i].offset,
+                                                  object->symbols[i].value,
+                                                  object->symbols[i].length);
+    }
+    for(int i = 0; i < object->extern_count; i++)
+    {
+        fprintf(object_fd, "EXTERN %s %d\n", object->externs[i].name,
+                                            object->externs[i].length);
+    }
+
+    fprintf(object_fd, "CODE %d\n", object->code_line_count);
+    for(int i = 0; i < object->code_line_count; i++)
+    {
+        fprintf(object_fd, "%s\n", object->code_lines[i]);
+    }
+
+    for(int i = 0; i < object->relocation_count; i++)
+    {
+        struct object_relocation *reloc = &object->relocations[i];
+        fprintf(object_fd, "RELOC %d %s %s %d\n", reloc->code_line,
+                                                 reloc->byte == RELOC_HI ? "HI" : "LO",
+                                                 reloc->symbol,
+                                                 reloc->addend);
+    }
+
+    fprintf(object_fd, "LINES %d\n", object->line_table_count);
+    for(int i = 0; i < object->line_table_count; i++)
+    {
+        fprintf(object_fd, "%s\n", object->line_table[i]);
+    }
+
+    fprintf(object_fd, "END\n");
+    fclose(object_fd);
+}
+
+static void
+remove_newline(char *str)
+{
+    char *newline = strchr(str, '\n');
+
+    if(newline)
+    {
+        *newline = '\0';
+    }
+}
+
+static void
+read_lines(FILE *object_fd, const char *filename, int count,
+           char ***lines, int *line_count)
+{
+    char buffer[MAX_LINE_SIZE_CHAR];
+
+    for(int i = 0; i < count; i++)
+    {
+        if(fgets(buffer, sizeof(buffer), object_fd) == NULL)
+        {
+            fatal_error("Object file %s is truncated\n", filename);
+        }
+        remove_newline(buffer);
+        *lines = append_line(*lines, line_count, buffer);
+    }
+}
+
+void
+object_read(const char *filename, struct object_file *object)
+{
+    char buffer[MAX_LINE_SIZE_CHAR];
+    char name[MAX_SYMBOL_NAME];
+    char byte[4];
+    int value0, value1, value2;
+
+    object_init(object);
+    FILE *object_fd = fopen(filename, "r");
+    if(object_fd == NULL) fatal_error("Failed to open object file: %s\n", filename);
+
+    if(fgets(buffer, sizeof(buffer), object_fd) == NULL
+       || sscanf(buffer, "SCCOBJ %d", &value0) != 1)
+    {
+        fatal_error("%s is not an SCC object file\n", filename);
+    }
+    if(value0 != OBJECT_FORMAT_VERSION)
+    {
+        fatal_error("%s has unsupported object version %d\n", filename, value0);
+    }
+
+    int found_end = 0;
+    while(fgets(buffer, sizeof(buffer), object_fd) != NULL)
+    {
+        remove_newline(buffer);
+
+        if(sscanf(buffer, "MODULE %63s", name) == 1) copy_name(object->module, name);
+        else if(sscanf(buffer, "SOURCE %63s", name) == 1) copy_name(object->source, name);
+        else if(sscanf(buffer, "PROG_MEMORY_START %d", &value0) == 1)
+        {
+            object->prog_memory_start = value0;
+        }
+        else if(sscanf(buffer, "PROG_MEMORY_END %d", &value0) == 1)
+        {
+            object->prog_memory_end = value0;
+        }
+        else if(sscanf(buffer, "DATA_MEMORY_START %d", &value0) == 1)
+        {
+            object->data_memory_start = value0;
+        }
+        else if(sscanf(buffer, "DATA_MEMORY_END %d", &value0) == 1)
+        {
+            object->data_memory_end = value0;
+        }
+        else if(sscanf(buffer, "CODE_SIZE %d", &value0) == 1)
+        {
+            object->code_size = value0;
+        }
+        else if(sscanf(buffer, "DATA_SIZE %d", &value0) == 1)
+        {
+            object->data_size = value0;
+        }
+        else if(sscanf(buffer, "IMPORT %63s", name) == 1)
+        {
+            object_add_import(object, name);
+        }
+        else if(sscanf(buffer, "SYMBOL %63s %d %d %d", name, &value0, &value1,
+                                                      &value2) == 4)
+        {
+            object_add_symbol(object, name, value0, value1, value2);
+        }
+        else if(sscanf(buffer, "EXTERN %63s %d", name, &value0) == 2)
+        {
+            object_add_extern(object, name, value0);
+        }
+        else if(sscanf(buffer, "CODE %d", &value0) == 1)
+        {
+            read_lines(object_fd, filename, value0,
+                       &object->code_lines, &object->code_line_count);
+        }
+        else if(sscanf(buffer, "RELOC %d %3s %63s %d", &value0, byte, name,
+                                                      &value1) == 4)
+        {
+            object->relocations = realloc(object->relocations,
+                                          (object->relocation_count + 1)
+                                          * sizeof(*object->relocations));
+            if(object->relocations == NULL) fatal_error("Out of memory\n");
+
+            struct object_relocation *reloc =
+                &object->relocations[object->relocation_count++];
+            reloc->code_line = value0;
+            reloc->byte = strcmp(byte, "HI") == 0 ? RELOC_HI : RELOC_LO;
+            copy_name(reloc->symbol, name);
+            reloc->addend = value1;
+        }
+        else if(sscanf(buffer, "LINES %d", &value0) == 1)
+        {
+            read_lines(object_fd, filename, value0,
+                       &object->line_table, &object->line_table_count);
+        }
+        else if(strcmp(buffer, "END") == 0)
+        {
+            found_end = 1;
+            break;
+        }
+        else fatal_error("Unrecognized line in %s: %s\n", filename, buffer);
+    }
+    fclose(object_fd);
+
+    if(!found_end) fatal_error("Object file %s is truncated\n", filename);
+    for(int i = 0; i < object->relocation_count; i++)
+    {
+        if(object->relocations[i].code_line < 0
+           || object->relocations[i].code_line >= object->code_line_count)
+        {
+            fatal_error("Relocation outside of code in %s\n", filename);
+        }
+    }
+}
+
+/**
+ * @brief Module name is the filename without directories or extension
+ *
+ * @param filename .scc or .sco path
+ * @param module output buffer of MAX_SYMBOL_NAME chars
+ *
+ */
+void
+object_module_name(const char *filename, char *module)
+{
+    const char *base = strrchr(filename, '/');
+    base = (base == NULL) ? filename : base + 1;
+
+    char buffer[MAX_LINE_SIZE_CHAR];
+    strncpy(buffer, base, sizeof(buffer) - 1);
+    buffer[sizeof(buffer) - 1] = '\0';
+
+    char *dot = strrchr(buffer, '.');
+    if(dot != NULL && dot != buffer) *dot = '\0';
+    copy_name(module, buffer);
+}
+
+/* End of file: object.c */
@@ -0,0 +1,258 @@
+/*
+ * File name: procs.c
+ * Description: Finds the procs in a .scc file before it is compiled and
+ *              decides which ones get inlined at their call sites.
+ *
+ * Notes:
+ *      A proc is inlined when it has one call site, when inlining it is no
+ *      bigger than keeping it out of line, or when it is a leaf whose body
+ *      is at most the inline threshold instructions. Procs with no call
+ *      sites are not written at all.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "../include/errors.h"
+#include "../include/scc.h"
+#include "../include/procs.h"
+
+static struct proc procs[MAX_PROCS];
+static int proc_count = 0;
+
+static int inlining_enabled = 1;
+static int inline_threshold = DEFAULT_INLINE_THRESHOLD;
+
+void
+procs_set_inlining(int enabled, int threshold)
+{
+    inlining_enabled = enabled;
+    inline_threshold = threshold;
+}
+
+struct proc *
+procs_find(const char *name)
+{
+    for(int i = 0; i < proc_count; i++)
+    {
+        if(strcmp(procs[i].name, name) == 0) return &procs[i];
+    }
+    return NULL;
+}
+
+/**
+ * @brief Estimated instructions main.c writes for one line of code
+ *
+ */
+int
+procs_statement_cost(char *line)
+{
+    char buffer[MAX_LINE_SIZE_CHAR];
+    strcpy(buffer, line);
+
+    char *column_0 = strtok(buffer, " ");
+    if(column_0 == NULL) return 0;
+
+    int token_count = 1;
+    char *operand = NULL;
+    char *token;
+    while((token = strtok(NULL, " ")) != NULL)
+    {
+        token_count++;
+        if(token_count == 3) operand = token;
+    }
+
+    if(strcmp(column_0, "if") == 0) return 13;
+    if(strcmp(column_0, "loop") == 0) return 5;
+    //} in a proc body always ends a loop, see samco_loop_end
+    if(strcmp(column_0, "}") == 0) return 14;
+    if(strcmp(column_0, "call") == 0) return PROC_CALL_COST;
+    if(strcmp(column_0, "fill") == 0 || strcmp(column_0, "copy") == 0) return 30;
+    if(strcmp(column_0, "{") == 0 || strcmp(column_0, "<") == 0
+       || strcmp(column_0, ">") == 0 || strcmp(column_0, "//") == 0)
+    {
+        return 0;
+    }
+
+    //assignment, a = b is 5 or 6 and a = b + c is 11 to 13. Element and
+    //whole array assignments cost more but are not told apart here.
+    if(token_count == 3)
+    {
+        char *digits = operand;
+        if(*digits == '-' || *digits == '+') digits++;
+        return (strspn(digits, "0123456789") == strlen(digits)) ? 5 : 6;
+    }
+    return 12;
+}
+
+/**
+ * @brief Instructions a proc takes when written once out of line, not
+ *        counting its call sites
+ *
+ */
+int
+procs_out_of_line_size(struct proc *proc)
+{
+    int linkage = proc->is_leaf ? PROC_LEAF_RETURN_COST
+                                : PROC_SAVE_LINK_COST + PROC_RESTORE_LINK_COST;
+    return PROC_JUMP_OVER_COST + proc->cost + linkage;
+}
+
+static int
+should_inline(struct proc *proc)
+{
+    if(proc->call_sites == 0) return 1;
+    if(!inlining_enabled) return 0;
+    if(proc->call_sites == 1) return 1;
+
+    int inlined_size = proc->cost * proc->call_sites;
+    int out_of_line_size = procs_out_of_line_size(proc)
+                           + PROC_CALL_COST * proc->call_sites;
+    if(inlined_size <= out_of_line_size) return 1;
+
+    return proc->is_leaf && proc->cost <= inline_threshold;
+}
+
+static void
+add_body_line(struct proc *proc, char *line, int line_index)
+{
+    proc->body = realloc(proc->body, (proc->body_count + 1) * sizeof(char *));
+    proc->body_line_index = realloc(proc->body_line_index,
+                                    (proc->body_count + 1) * sizeof(int));
+    if(proc->body == NULL || proc->body_line_index == NULL)
+    {
+        fatal_error("Out of memory\n");
+    }
+
+    proc->body[proc->body_count] = strdup(line);
+    if(proc->body[proc->body_count] == NULL) fatal_error("Out of memory\n");
+    proc->body_line_index[proc->body_count] = line_index;
+    proc->body_count++;
+    proc->cost = proc->cost + procs_statement_cost(line);
+}
+
+/**
+ * @brief Reads the whole .scc file, records every proc body and counts the
+ *        call sites of each proc. Leaves scc_fd rewound.
+ *
+ * @param scc_fd open .scc input
+ *
+ */
+void
+procs_scan(FILE *scc_fd)
+{
+    char line_buffer[MAX_LINE_SIZE_CHAR];
+    char column_buffer[MAX_LINE_SIZE_CHAR];
+    struct proc *current = NULL;
+    int depth = 0;
+    int line_index = 1;
+
+    char (*call_names)[MAX_PROC_NAME] = NULL;
+    int *call_lines = NULL;
+    int call_count = 0;
+
+    for(; fgets(line_buffer, sizeof(line_buffer), scc_fd) != NULL; line_index++)
+    {
+        char *newline = strchr(line_buffer, '\n');
+        if(newline) *newline = '\0';
+
+        strcpy(column_buffer, line_buffer);
+        char *column_0 = strtok(column_buffer, " ");
+        if(column_0 == NULL) continue;
+        char *column_1 = strtok(NULL, " ");
+
+        if(strcmp(column_0, "call") == 0)
+        {
+            if(column_1 == NULL) fatal_error("call needs a proc on line: %d\n", line_index);
+            call_names = realloc(call_names, (call_count + 1) * MAX_PROC_NAME);
+            call_lines = realloc(call_lines, (call_count + 1) * sizeof(int));
+            if(call_names == NULL || call_lines == NULL) fatal_error("Out of memory\n");
+            snprintf(call_names[call_count], MAX_PROC_NAME, "%s", column_1);
+            call_lines[call_count] = line_index;
+            call_count++;
+
+            if(current != NULL)
+            {
+                if(strcmp(column_1, current->name) == 0)
+                {
+                    fatal_error("proc %s calls itself on line: %d\n",
+                                current->name, line_index);
+                }
+                current->is_leaf = 0;
+            }
+        }
+
+        if(strcmp(column_0, "proc") == 0)
+        {
+            if(current != NULL) fatal_error("Nested proc on line: %d\n", line_index);
+            if(column_1 == NULL) fatal_error("proc needs a name on line: %d\n", line_index);
+            if(strlen(column_1) >= MAX_PROC_NAME) fatal_error("Proc name too long: %s\n", column_1);
+            if(procs_find(column_1) != NULL)
+            {
+                fatal_error("proc %s defined twice on line: %d\n", column_1, line_index);
+            }
+            if(proc_count >= MAX_PROCS) fatal_error("Too many procs\n");
+
+            current = &procs[proc_count++];
+            memset(current, 0, sizeof(*current));
+            strcpy(current->name, column_1);
+            current->first_line = line_index;
+            current->is_leaf = 1;
+            current->entry_addr = -1;
+            depth = 0;
+        }
+        else if(current != NULL && depth == 0)
+        {
+            if(strcmp(column_0, "{") != 0)
+            {
+                fatal_error("Expected { after proc %s on line: %d\n",
+                            current->name, line_index);
+            }
+            depth = 1;
+        }
+        else if(current != NULL)
+        {
+            if(strcmp(column_0, "var") == 0)
+            {
+                fatal_error("var inside proc %s on line: %d, declare it before the proc\n",
+                            current->name, line_index);
+            }
+            if(strcmp(column_0, "{") == 0) depth++;
+            if(strcmp(column_0, "}") == 0) depth--;
+
+            if(depth == 0)
+            {
+                current->last_line = line_index;
+                current = NULL;
+            }
+            else add_body_line(current, line_buffer, line_index);
+        }
+    }
+
+    if(current != NULL) fatal_error("proc %s is missing its closing }\n", current->name);
+
+    for(int i = 0; i < call_count; i++)
+    {
+        struct proc *proc = procs_find(call_names[i]);
+        if(proc == NULL)
+        {
+            fatal_error("Couldnt find proc %s called on line: %d\n",
+                        call_names[i], call_lines[i]);
+        }
+        if(proc->first_line > call_lines[i])
+        {
+            fatal_error("proc %s called on line: %d before it is defined\n",
+                        call_names[i], call_lines[i]);
+        }
+        proc->call_sites++;
+    }
+    free(call_names);
+    free(call_lines);
+
+    for(int i = 0; i < proc_count; i++) procs[i].inlined = should_inline(&procs[i]);
+
+    rewind(scc_fd);
+}
+
+/* End of file: procs.c */
@@ -0,0 +1,397 @@
+/*
+ * File name: profile.c
+ * Description: Execution counts for profile guided compiles. Writes the
+ *              block map for --profile-generate and reads the counts given
+ *              to --profile-use.
+ *
+ * Notes:
+ *      A .prof file has one '<line> <count>' pair per line, // comments
+ *      are allowed. Lines that are not listed have the count of the
+ *      closest listed line before them, which is the start of their block
+ *      when every line in the block map is listed.
+ *
+ *      The scan before compiling finds where each if body ends and plans
+ *      how far each array loop is unrolled. Spare program memory goes to
+ *      the hottest loops first, loops that never ran are not unrolled.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "../include/errors.h"
+#include "../include/scc.h"
+#include "../include/procs.h"
+#include "../include/profile.h"
+
+struct if_body
+{
+    int if_line;
+    int body_line;          //first statement of the body
+    int end_line;           //line of the closing >
+    int has_var;            //cant be moved, the var must exist after it
+};
+
+struct array_loop
+{
+    int line;
+    int length;
+    int unroll;
+};
+
+struct array_decl
+{
+    char name[MAX_LINE_SIZE_CHAR];
+    int length;
+};
+
+static long *line_counts;   //-1 if the line is not in the profile
+static int line_count_size = 0;
+
+static struct if_body *if_bodies;
+static int if_body_count = 0;
+
+static struct array_loop *array_loops;
+static int array_loop_count = 0;
+
+static FILE *block_map_fd;
+static const char *block_map_source;
+
+/**
+ * @brief Reads the per line execution counts from a .prof file
+ *
+ */
+void
+profile_load(const char *filename)
+{
+    char buffer[MAX_LINE_SIZE_CHAR];
+    int line;
+    long count;
+    int file_line = 0;
+
+    FILE *profile_fd = fopen(filename, "r");
+    if(profile_fd == NULL) fatal_error("Failed to open profile: %s\n", filename);
+
+    while(fgets(buffer, sizeof(buffer), profile_fd) != NULL)
+    {
+        file_line++;
+        if(strncmp(buffer, "//", 2) == 0 || strspn(buffer, " \t\r\n") == strlen(buffer))
+        {
+            continue;
+        }
+        if(sscanf(buffer, "%d %ld", &line, &count) != 2 || line < 1 || count < 0)
+        {
+            fatal_error("%s:%d: expected '<line> <count>'\n", filename, file_line);
+        }
+
+        if(line >= line_count_size)
+        {
+            line_counts = realloc(line_counts, (line + 1) * sizeof(long));
+            if(line_counts == NULL) fatal_error("Out of memory\n");
+            for(int i = line_count_size; i <= line; i++) line_counts[i] = -1;
+            line_count_size = line + 1;
+        }
+        //Inlined code lists a line once per copy
+        if(line_counts[line] < 0) line_counts[line] = 0;
+        line_counts[line] = line_counts[line] + count;
+    }
+    fclose(profile_fd);
+    if(line_counts == NULL) fatal_error("Profile %s has no counts\n", filename);
+}
+
+int
+profile_loaded()
+{
+    return line_counts != NULL;
+}
+
+/**
+ * @brief Times line ran, 0 before the first listed line or without a
+ *        profile
+ *
+ */
+long
+profile_line_count(int line)
+{
+    if(line >= line_count_size) line = line_count_size - 1;
+    for(; line > 0; line--)
+    {
+        if(line_counts[line] >= 0) return line_counts[line];
+    }
+    return 0;
+}
+
+static struct if_body *
+find_if_body(int if_line)
+{
+    for(int i = 0; i < if_body_count; i++)
+    {
+        if(if_bodies[i].if_line == if_line) return &if_bodies[i];
+    }
+    return NULL;
+}
+
+/**
+ * @brief Line of the > closing the if on if_line
+ *
+ */
+int
+profile_if_end_line(int if_line)
+{
+    struct if_body *body = find_if_body(if_line);
+    if(body == NULL || body->end_line == 0)
+    {
+        fatal_error("if statement on line: %d missing closing >\n", if_line);
+    }
+    return body->end_line;
+}
+
+/**
+ * @brief An if body is cold when the profile says it ran for fewer than
+ *        half of the times the if did
+ *
+ */
+int
+profile_if_body_is_cold(int if_line)
+{
+    if(!profile_loaded()) return 0;
+
+    struct if_body *body = find_if_body(if_line);
+    if(body == NULL || body->body_line == 0 || body->has_var) return 0;
+    return profile_line_count(body->body_line) * 2 < profile_line_count(if_line);
+}
+
+/**
+ * @brief Most array elements the loop written for line may handle per pass
+ *
+ */
+int
+profile_array_unroll(int line)
+{
+    for(int i = 0; i < array_loop_count; i++)
+    {
+        if(array_loops[i].line == line) return array_loops[i].unroll;
+    }
+    return MAX_ARRAY_LOOP_UNROLL;
+}
+
+static int
+array_length(struct array_decl *arrays, int array_count, const char *name)
+{
+    for(int i = 0; i < array_count; i++)
+    {
+        if(strcmp(arrays[i].name, name) == 0) return arrays[i].length;
+    }
+    return 0;
+}
+
+static void
+add_array_loop(int line, int length)
+{
+    array_loops = realloc(array_loops, (array_loop_count + 1) * sizeof(*array_loops));
+    if(array_loops == NULL) fatal_error("Out of memory\n");
+    array_loops[array_loop_count].line = line;
+    array_loops[array_loop_count].length = length;
+    array_loops[array_loop_count].unroll = MAX_ARRAY_LOOP_UNROLL;
+    array_loop_count++;
+}
+
+static int
+hotter_array_loop(const void *a, const void *b)
+{
+    const struct array_loop *loop_a = a;
+    const struct array_loop *loop_b = b;
+    long count_a = profile_line_count(loop_a->line);
+    long count_b = profile_line_count(loop_b->line);
+    if(count_a != count_b) return (count_a > count_b) ? -1 : 1;
+    return loop_a->line - loop_b->line;
+}
+
+/**
+ * @brief Hands the program memory left once every array loop handles one
+ *        element per pass to the hottest loops first
+ *
+ * @param spare estimated free program memory
+ *
+ */
+static void
+plan_array_unroll(int spare)
+{
+    //array_loops is NULL until the first array loop is found
+    if(array_loop_count > 1)
+    {
+        qsort(array_loops, array_loop_count, sizeof(*array_loops), hotter_array_loop);
+    }
+
+    for(int i = 0; i < array_loop_count; i++)
+    {
+        struct array_loop *loop = &array_loops[i];
+        int unroll = MAX_ARRAY_LOOP_UNROLL;
+        if(profile_line_count(loop->line) == 0) unroll = 1;
+        while(unroll > 1 && (loop->length % unroll != 0
+                             || (unroll - 1) * PROFILE_ARRAY_ELEMENT_COST > spare))
+        {
+            unroll--;
+        }
+        loop->unroll = unroll;
+        spare = spare - (unroll - 1) * PROFILE_ARRAY_ELEMENT_COST;
+    }
+}
+
+/**
+ * @brief Reads the whole .scc file to match if statements with their >
+ *        and, with a profile, plan the array loops. Leaves scc_fd rewound.
+ *
+ * @param scc_fd open .scc input
+ *
+ */
+void
+profile_scan(FILE *scc_fd)
+{
+    char line_buffer[MAX_LINE_SIZE_CHAR];
+    char column_buffer[MAX_LINE_SIZE_CHAR];
+    char name[MAX_LINE_SIZE_CHAR];
+    int open_ifs[MAX_NESTED_BLOCKS];
+    int open_if_count = 0;
+    struct array_decl *arrays = NULL;
+    int array_count = 0;
+    int prog_memory_start = 0;
+    int prog_memory_end = 0;
+    int estimated_size = 0;
+    int in_code = 0;
+
+    for(int line_index = 1; fgets(line_buffer, sizeof(line_buffer), scc_fd) != NULL; line_index++)
+    {
+        char *newline = strchr(line_buffer, '\n');
+        if(newline) *newline = '\0';
+
+        strcpy(column_buffer, line_buffer);
+        char *column_0 = strtok(column_buffer, " ");
+        if(column_0 == NULL) continue;
+        char *column_1 = strtok(NULL, " ");
+        char *column_2 = strtok(NULL, " ");
+        char *column_3 = strtok(NULL, " ");
+
+        if(!in_code)
+        {
+            if(strcmp(column_0, "PROG_MEMORY_START") == 0 && column_1 != NULL)
+            {
+                prog_memory_start = atoi(column_1);
+            }
+            if(strcmp(column_0, "PROG_MEMORY_END") == 0 && column_1 != NULL)
+            {
+                prog_memory_end = atoi(column_1);
+            }
+            if(strcmp(column_0, "CODE_BEGIN") == 0) in_code = 1;
+            continue;
+        }
+        if(strcmp(column_0, "CODE_END") == 0) break;
+        if(strcmp(column_0, "//") == 0 || strcmp(column_0, "<") == 0) continue;
+
+        if(open_if_count > 0 && strcmp(column_0, ">") != 0)
+        {
+            struct if_body *body = &if_bodies[open_ifs[open_if_count - 1]];
+            if(body->body_line == 0) body->body_line = line_index;
+        }
+
+        if(strcmp(column_0, "if") == 0)
+        {
+            if(open_if_count >= MAX_NESTED_BLOCKS)
+            {
+                fatal_error("If statements nested too deep on line: %d\n", line_index);
+            }
+            if_bodies = realloc(if_bodies, (if_body_count + 1) * sizeof(*if_bodies));
+            if(if_bodies == NULL) fatal_error("Out of memory\n");
+            memset(&if_bodies[if_body_count], 0, sizeof(*if_bodies));
+            if_bodies[if_body_count].if_line = line_index;
+            open_ifs[open_if_count++] = if_body_count++;
+        }
+        else if(strcmp(column_0, ">") == 0)
+        {
+            if(open_if_count == 0) fatal_error("> without matching if on line: %d\n", line_index);
+            if_bodies[open_ifs[--open_if_count]].end_line = line_index;
+        }
+        else if(strcmp(column_0, "var") == 0 && column_1 != NULL)
+        {
+            for(int i = 0; i < open_if_count; i++) if_bodies[open_ifs[i]].has_var = 1;
+
+            char *open = strchr(column_1, '[');
+            if(open != NULL)
+            {
+                strncpy(name, column_1, open - column_1);
+                name[open - column_1] = '\0';
+                arrays = realloc(arrays, (array_count + 1) * sizeof(*arrays));
+                if(arrays == NULL) fatal_error("Out of memory\n");
+                strcpy(arrays[array_count].name, name);
+                arrays[array_count].length = atoi(open + 1);
+                array_count++;
+                if(column_3 != NULL) add_array_loop(line_index, atoi(open + 1));
+            }
+        }
+        else if((strcmp(column_0, "fill") == 0 || strcmp(column_0, "copy") == 0)
+                && column_1 != NULL && array_length(arrays, array_count, column_1) > 0)
+        {
+            add_array_loop(line_index, array_length(arrays, array_count, column_1));
+        }
+        else if(column_1 != NULL && strcmp(column_1, "=") == 0 && column_2 != NULL
+                && array_length(arrays, array_count, column_0) > 0)
+        {
+            add_array_loop(line_index, array_length(arrays, array_count, column_0));
+        }
+
+        if(array_loop_count > 0 && array_loops[array_loop_count - 1].line == line_index)
+        {
+            estimated_size = estimated_size + PROFILE_ARRAY_LOOP_COST
+                             + PROFILE_ARRAY_ELEMENT_COST;
+        }
+        else estimated_size = estimated_size + procs_statement_cost(line_buffer);
+    }
+    free(arrays);
+
+    if(profile_loaded())
+    {
+        plan_array_unroll(prog_memory_end - prog_memory_start + 1 - estimated_size);
+    }
+    else
+    {
+        //Without counts every loop keeps the full unroll
+        array_loop_count = 0;
+    }
+
+    rewind(scc_fd);
+}
+
+/**
+ * @brief Opens the block map written for --profile-generate
+ *
+ */
+void
+profile_block_map_open(const char *map_filename, const char *source_filename)
+{
+    block_map_fd = fopen(map_filename, "w");
+    if(block_map_fd == NULL) fatal_error("Failed to open block map: %s\n", map_filename);
+    block_map_source = source_filename;
+
+    fprintf(block_map_fd, "//SCC block map\n");
+    fprintf(block_map_fd, "//addr source line\n");
+}
+
+/**
+ * @brief Records that the block starting at addr belongs to line
+ *
+ */
+void
+profile_block_map_add(int addr, int line)
+{
+    if(block_map_fd == NULL) return;
+    fprintf(block_map_fd, "%d %s %d\n", addr, block_map_source, line);
+}
+
+void
+profile_block_map_close()
+{
+    if(block_map_fd != NULL) fclose(block_map_fd);
+    block_map_fd = NULL;
+}
+
+/* End of file: profile.c */
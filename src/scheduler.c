@@ -0,0 +1,453 @@
+/*
+ * File name: scheduler.c
+ * Description: Reorders the instructions of each basic block of a finished
+ *              SCC ASM file to hide the latencies in the machine
+ *              description.
+ *
+ * Notes:
+ *      A region is a run of instructions with no comment or blank line in
+ *      it, split after every jz. Every statement starts with a comment so
+ *      instructions never move into another statement and the line table
+ *      stays exact. Jump targets inside a statement must be marked with a
+ *      comment line.
+ *
+ *      The jz ending a region stays at the end of it. add, sub, mul and
+ *      div set the zero flag and jz reads it, so they are ordered like a
+ *      write and a read of one more register. lshf, GET and PUT leave the
+ *      flag alone and may go between the instruction setting it and the
+ *      jz. A region is only written in the new order when that has fewer
+ *      estimated stalls.
+ *
+ *      Stalls are estimated per region for an in-order core that starts
+ *      the region with nothing in flight.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <strings.h>
+
+#include "../include/errors.h"
+#include "../include/scc.h"
+#include "../include/machine.h"
+#include "../include/scheduler.h"
+
+#define NO_REGISTER             -1
+
+//What an instruction does to registers and data memory
+struct instruction
+{
+    char *text;
+    int delay;              //cycles until its result can be used
+    int writes;             //register written or NO_REGISTER
+    int reads[MAX_INSTRUCTION_OPERANDS];
+    int read_count;
+    int loads;              //GET
+    int stores;             //PUT
+    int is_jump;
+    int sets_flag;          //add, sub, mul and div set the zero flag
+    int reads_flag;         //jz
+    int shifts;             //lshf, 2 once it completes a 16 bit load
+    int pinned;             //kept at the end of the region
+};
+
+struct dependence
+{
+    int from;
+    int to;
+    int delay;
+};
+
+static int
+register_index(const char *name)
+{
+    if(strcasecmp(name, "DR") == 0) return 0;
+    if((name[0] == 'r' || name[0] == 'R') && name[1] >= '1' && name[1] <= '7'
+       && name[2] == '\0')
+    {
+        return name[1] - '0';
+    }
+    return NO_REGISTER;
+}
+
+/**
+ * @brief Fills in what line does to registers and memory
+ *
+ * @return 0 if the line is not an instruction the scheduler understands,
+ *         it is then left where it is
+ *
+ */
+static int
+decode_instruction(char *line, struct instruction *instruction)
+{
+    char buffer[MAX_LINE_SIZE_CHAR];
+    char *operands[MAX_INSTRUCTION_OPERANDS];
+    int operand_count = 0;
+
+    snprintf(buffer, sizeof(buffer), "%s", line);
+    char *opcode = strtok(buffer, " ,\t\r\n");
+    if(opcode == NULL) return 0;
+    char *token;
+    while((token = strtok(NULL, " ,\t\r\n")) != NULL)
+    {
+        if(operand_count == MAX_INSTRUCTION_OPERANDS) return 0;
+        operands[operand_count++] = token;
+    }
+
+    memset(instruction, 0, sizeof(*instruction));
+    instruction->text = line;
+    instruction->delay = machine_result_delay(opcode);
+    instruction->writes = NO_REGISTER;
+
+    int first = (operand_count > 0) ? register_index(operands[0]) : NO_REGISTER;
+    int second = (operand_count > 1) ? register_index(operands[1]) : NO_REGISTER;
+
+    if(strcasecmp(opcode, "lshf") == 0)
+    {
+        if(operand_count != 2 || first == NO_REGISTER) return 0;
+        instruction->writes = first;
+        instruction->reads[instruction->read_count++] = first;
+        instruction->shifts = 1;
+    }
+    else if(strcasecmp(opcode, "get") == 0)
+    {
+        if(first == NO_REGISTER || second == NO_REGISTER) return 0;
+        instruction->writes = first;
+        instruction->reads[instruction->read_count++] = second;
+        instruction->loads = 1;
+    }
+    else if(strcasecmp(opcode, "put") == 0)
+    {
+        if(first == NO_REGISTER || second == NO_REGISTER) return 0;
+        instruction->reads[instruction->read_count++] = first;
+        instruction->reads[instruction->read_count++] = second;
+        instruction->stores = 1;
+    }
+    else if(strcasecmp(opcode, "add") == 0 || strcasecmp(opcode, "sub") == 0
+            || strcasecmp(opcode, "mul") == 0 || strcasecmp(opcode, "div") == 0)
+    {
+        if(first == NO_REGISTER || second == NO_REGISTER) return 0;
+        instruction->writes = first;
+        instruction->reads[instruction->read_count++] = first;
+        instruction->reads[instruction->read_count++] = second;
+        instruction->sets_flag = 1;
+    }
+    else if(strcasecmp(opcode, "jz") == 0)
+    {
+        if(operand_count != 1 || first == NO_REGISTER) return 0;
+        instruction->reads[instruction->read_count++] = first;
+        instruction->reads_flag = 1;
+        instruction->is_jump = 1;
+    }
+    else return 0;
+
+    return 1;
+}
+
+static int
+reads_register(struct instruction *instruction, int reg)
+{
+    for(int i = 0; i < instruction->read_count; i++)
+    {
+        if(instruction->reads[i] == reg) return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Cycles instruction to must wait after instruction from issues,
+ *        or -1 if they can go in any order
+ *
+ */
+static int
+dependence_delay(struct instruction *from, struct instruction *to)
+{
+    int delay = -1;
+
+    //read after write
+    if(from->writes != NO_REGISTER && reads_register(to, from->writes))
+    {
+        delay = from->delay;
+    }
+    //write after write
+    if(from->writes != NO_REGISTER && to->writes == from->writes && delay < 1)
+    {
+        delay = 1;
+    }
+    //write after read
+    if(to->writes != NO_REGISTER && reads_register(from, to->writes) && delay < 0)
+    {
+        delay = 0;
+    }
+
+    //The zero flag is ordered like one more register
+    if(from->sets_flag && to->reads_flag && delay < from->delay) delay = from->delay;
+    if(from->sets_flag && to->sets_flag && delay < 1) delay = 1;
+    if(from->reads_flag && to->sets_flag && delay < 0) delay = 0;
+
+    //Addresses are not known here so loads and stores keep their order
+    if(from->stores && to->loads && delay < from->delay) delay = from->delay;
+    if((from->loads || from->stores) && to->stores && delay < 0) delay = 0;
+
+    if(!from->pinned && to->pinned && delay < 0) delay = 0;
+    return delay;
+}
+
+/**
+ * @brief Stall cycles issuing the region in order
+ *
+ * @param order instruction indexes in issue order
+ *
+ */
+static int
+count_stalls(struct instruction *region, int count, int *order)
+{
+    int width = machine_issue_width();
+    int *issue_cycle = malloc(count * sizeof(int));
+    if(issue_cycle == NULL) fatal_error("Out of memory\n");
+
+    int cycle = 0;
+    int issued_this_cycle = 0;
+    int stalls = 0;
+    for(int i = 0; i < count; i++)
+    {
+        int ready = cycle;
+        for(int j = 0; j < i; j++)
+        {
+            int delay = dependence_delay(&region[order[j]], &region[order[i]]);
+            if(delay >= 0 && issue_cycle[order[j]] + delay > ready)
+            {
+                ready = issue_cycle[order[j]] + delay;
+            }
+        }
+        if(ready > cycle)
+        {
+            stalls = stalls + ready - cycle;
+            cycle = ready;
+            issued_this_cycle = 0;
+        }
+
+        issue_cycle[order[i]] = cycle;
+        issued_this_cycle++;
+        if(issued_this_cycle == width)
+        {
+            cycle++;
+            issued_this_cycle = 0;
+        }
+    }
+    free(issue_cycle);
+    return stalls;
+}
+
+/**
+ * @brief Cycle by cycle list scheduling, the ready instruction on the
+ *        longest path to the end of the region goes first
+ *
+ * @param order filled with instruction indexes in the new issue order
+ *
+ */
+static void
+list_schedule(struct instruction *region, int count, int *order)
+{
+    int width = machine_issue_width();
+    struct dependence *edges = NULL;
+    int edge_count = 0;
+
+    for(int i = 0; i < count; i++)
+    {
+        for(int j = i + 1; j < count; j++)
+        {
+            int delay = dependence_delay(&region[i], &region[j]);
+            if(delay < 0) continue;
+            edges = realloc(edges, (edge_count + 1) * sizeof(*edges));
+            if(edges == NULL) fatal_error("Out of memory\n");
+            edges[edge_count].from = i;
+            edges[edge_count].to = j;
+            edges[edge_count].delay = delay;
+            edge_count++;
+        }
+    }
+
+    //Edges only point forward so one backward pass finds every path length
+    int *priority = calloc(count, sizeof(int));
+    int *issue_cycle = calloc(count, sizeof(int));
+    int *scheduled = calloc(count, sizeof(int));
+    if(priority == NULL || issue_cycle == NULL || scheduled == NULL)
+    {
+        fatal_error("Out of memory\n");
+    }
+    for(int i = count - 1; i >= 0; i--)
+    {
+        priority[i] = region[i].delay;
+        for(int e = 0; e < edge_count; e++)
+        {
+            if(edges[e].from != i) continue;
+            int length = edges[e].delay + priority[edges[e].to];
+            if(length > priority[i]) priority[i] = length;
+        }
+    }
+
+    int cycle = 0;
+    int placed = 0;
+    while(placed < count)
+    {
+        int issued_this_cycle = 0;
+        while(issued_this_cycle < width)
+        {
+            int best = -1;
+            for(int i = 0; i < count; i++)
+            {
+                if(scheduled[i]) continue;
+                int ready = 1;
+                for(int e = 0; e < edge_count && ready; e++)
+                {
+                    if(edges[e].to != i) continue;
+                    if(!scheduled[edges[e].from]
+                       || issue_cycle[edges[e].from] + edges[e].delay > cycle)
+                    {
+                        ready = 0;
+                    }
+                }
+                if(ready && (best == -1 || priority[i] > priority[best])) best = i;
+            }
+            if(best == -1) break;
+
+            scheduled[best] = 1;
+            issue_cycle[best] = cycle;
+            order[placed++] = best;
+            issued_this_cycle++;
+        }
+        cycle++;
+    }
+
+    free(edges);
+    free(priority);
+    free(issue_cycle);
+    free(scheduled);
+}
+
+/**
+ * @brief Schedules one region and writes it to out_fd
+ *
+ */
+static void
+schedule_region(struct instruction *region, int count, int reorder,
+                FILE *out_fd, struct schedule_stats *stats)
+{
+    if(count == 0) return;
+
+    int *original = malloc(count * sizeof(int));
+    int *order = malloc(count * sizeof(int));
+    if(original == NULL || order == NULL) fatal_error("Out of memory\n");
+    for(int i = 0; i < count; i++) original[i] = i;
+
+    if(region[count - 1].is_jump) region[count - 1].pinned = 1;
+
+    int stalls_before = count_stalls(region, count, original);
+    int stalls_after = stalls_before;
+    int *chosen = original;
+    if(reorder && count > 1)
+    {
+        list_schedule(region, count, order);
+        int stalls = count_stalls(region, count, order);
+        if(stalls < stalls_after)
+        {
+            stalls_after = stalls;
+            chosen = order;
+            stats->regions_reordered++;
+        }
+    }
+
+    for(int i = 0; i < count; i++) fprintf(out_fd, "%s", region[chosen[i]].text);
+
+    stats->instructions = stats->instructions + count;
+    stats->regions++;
+    stats->stalls_before = stats->stalls_before + stalls_before;
+    stats->stalls_after = stats->stalls_after + stalls_after;
+
+    free(original);
+    free(order);
+}
+
+/**
+ * @brief Schedules every region of samco_filename in place
+ *
+ * @param reorder 0 only estimates the stalls of the file as written
+ * @param stats filled in for the schedule report
+ *
+ */
+void
+schedule_file(const char *samco_filename, int reorder,
+              struct schedule_stats *stats)
+{
+    char buffer[MAX_LINE_SIZE_CHAR];
+    char **lines = NULL;
+    int line_count = 0;
+
+    memset(stats, 0, sizeof(*stats));
+
+    FILE *samco_fd = fopen(samco_filename, "r");
+    if(samco_fd == NULL) fatal_error("Failed to open %s\n", samco_filename);
+    while(fgets(buffer, sizeof(buffer), samco_fd) != NULL)
+    {
+        lines = realloc(lines, (line_count + 1) * sizeof(char *));
+        if(lines == NULL) fatal_error("Out of memory\n");
+        lines[line_count] = strdup(buffer);
+        if(lines[line_count] == NULL) fatal_error("Out of memory\n");
+        line_count++;
+    }
+    fclose(samco_fd);
+
+    samco_fd = fopen(samco_filename, "w");
+    if(samco_fd == NULL) fatal_error("Failed to open %s\n", samco_filename);
+
+    struct instruction *region = malloc((line_count + 1) * sizeof(*region));
+    if(region == NULL) fatal_error("Out of memory\n");
+    int region_count = 0;
+
+    for(int i = 0; i < line_count; i++)
+    {
+        struct instruction instruction;
+        int is_instruction = strncmp(lines[i], "//", 2) != 0
+                             && decode_instruction(lines[i], &instruction);
+
+        if(!is_instruction)
+        {
+            schedule_region(region, region_count, reorder, samco_fd, stats);
+            region_count = 0;
+            fprintf(samco_fd, "%s", lines[i]);
+            //blank lines and comments are not instructions
+            if(strspn(lines[i], " \t\r\n") != strlen(lines[i])
+               && strncmp(lines[i], "//", 2) != 0)
+            {
+                stats->instructions++;
+            }
+            continue;
+        }
+
+        //Two lshf in a row load all 16 bits, the first does not read the
+        //old value so it only has to wait for readers of the register
+        struct instruction *previous = (region_count > 0) ? &region[region_count - 1] : NULL;
+        if(instruction.shifts && previous != NULL && previous->shifts == 1
+           && previous->writes == instruction.writes)
+        {
+            previous->read_count = 0;
+            instruction.shifts = 2;
+        }
+
+        region[region_count++] = instruction;
+        if(instruction.is_jump)
+        {
+            schedule_region(region, region_count, reorder, samco_fd, stats);
+            region_count = 0;
+        }
+    }
+    schedule_region(region, region_count, reorder, samco_fd, stats);
+    fclose(samco_fd);
+
+    for(int i = 0; i < line_count; i++) free(lines[i]);
+    free(lines);
+    free(region);
+}
+
+/* End of file: scheduler.c */
@@ -0,0 +1,24 @@
+/*
+ * File name: object_copy.c
+ * Description: Reads an SCC object file and writes it back out so the tests
+ *              can check object_read and object_write agree.
+ *
+ * Notes:
+ *      ./object_copy <in.sco> <out.sco>
+ */
+
+#include "../include/object.h"
+
+int
+main(int argc, char **argv)
+{
+    struct object_file object;
+
+    if(argc != 3) return 2;
+    object_read(argv[1], &object);
+    object_write(argv[2], &object);
+    object_free(&object);
+    return 0;
+}
+
+/* End of file: object_copy.c */
@@ -0,0 +1,107 @@
+#!/bin/sh
+#
+# Runs every tests/<name>.scc three ways and checks each against
+# tests/<name>.out:
+#   --run                     the bytecode interpreter
+#   SAMCO                     compiled, then run by tests/samco_sim
+#   --target=x86_64           assembled with cc and run, on x86-64 only
+#
+# tests/<name>.args holds extra SCC options for the test, for example a
+# profile. When tests/<name>.lines exists the SAMCO compile's line table
+# must match it too. tests/<name>.mach is the machine the SAMCO compile
+# is scheduled for, and when tests/<name>.samco exists the scheduled
+# program must match it. Programs with a -1 loop only stop on the step limit, so they
+# are not run on SAMCO.
+#
+# tests/link/<name>/ holds modules that are compiled with -c and linked
+# in the order its modules file lists them, <module>.args holding extra
+# SCC options for one module. Its out file is what
+# samco_sim prints for the linked program, or SCC-link's error when the
+# link must fail. Every object must also come back unchanged from
+# tests/object_copy.
+#
+# Run from the repo root after make: sh tests/run_tests.sh
+
+cd "$(dirname "$0")/.." || exit 1
+
+work=$(mktemp -d) || exit 1
+trap 'rm -rf "$work"' EXIT
+
+cc -o "$work/samco_sim" tests/samco_sim.c || exit 1
+cc -o "$work/object_copy" tests/object_copy.c src/object.c src/errors.c || exit 1
+
+native=0
+if [ "$(uname -m)" = "x86_64" ] && command -v cc >/dev/null; then native=1; fi
+
+failed=0
+count=0
+
+check()
+{
+    if cmp -s "$2" "$3"; then return; fi
+    echo "FAIL $1"
+    diff "$3" "$2" | sed 's/^/    /'
+    failed=$((failed + 1))
+}
+
+for scc in tests/*.scc; do
+    name=$(basename "$scc" .scc)
+    expected=tests/$name.out
+    args=""
+    if [ -f "tests/$name.args" ]; then args=$(cat "tests/$name.args"); fi
+    count=$((count + 1))
+
+    ./SCC --run "$scc" $args > "$work/run.out" 2>/dev/null
+    check "$name --run" "$work/run.out" "$expected"
+
+    samco_args=$args
+    if [ -f "tests/$name.mach" ]; then samco_args="$args --machine=tests/$name.mach"; fi
+
+    if ! grep -q "^loop -1" "$scc"; then
+        ./SCC "$scc" "$work/$name.samco" $samco_args > /dev/null &&
+            "$work/samco_sim" "$work/$name.samco" .temp > "$work/samco.out" 2>/dev/null
+        check "$name SAMCO" "$work/samco.out" "$expected"
+    fi
+
+    if [ -f "tests/$name.lines" ] || [ -f "tests/$name.samco" ]; then
+        ./SCC "$scc" "$work/$name.samco" $samco_args > /dev/null
+    fi
+    if [ -f "tests/$name.lines" ]; then
+        check "$name line table" "$work/$name.samco.lines" "tests/$name.lines"
+    fi
+    if [ -f "tests/$name.samco" ]; then
+        check "$name schedule" "$work/$name.samco" "tests/$name.samco"
+    fi
+
+    if [ $native = 1 ]; then
+        ./SCC "$scc" "$work/$name.s" --target=x86_64 $args > /dev/null &&
+            cc "$work/$name.s" -o "$work/$name" && "$work/$name" > "$work/x86.out"
+        check "$name x86_64" "$work/x86.out" "$expected"
+    fi
+done
+
+for dir in tests/link/*/; do
+    name=link/$(basename "$dir")
+    linked=$work/$name
+    mkdir -p "$linked"
+    count=$((count + 1))
+
+    objects=""
+    for module in $(cat "$dir/modules"); do
+        module_args=""
+        if [ -f "$dir/$module.args" ]; then module_args=$(cat "$dir/$module.args"); fi
+        ./SCC -c "$dir/$module.scc" "$linked/$module.sco" $module_args > /dev/null
+        "$work/object_copy" "$linked/$module.sco" "$linked/$module.copy"
+        check "$name $module object copy" "$linked/$module.copy" "$linked/$module.sco"
+        objects="$objects $linked/$module.sco"
+    done
+
+    if ./SCC-link "$linked/main.samco" $objects > "$linked/link.out"; then
+        "$work/samco_sim" "$linked/main.samco" "$linked/main.samco.vars" \
+            > "$linked/link.out" 2>/dev/null
+    fi
+    check "$name" "$linked/link.out" "$dir/out"
+done
+
+echo "$count tests, $failed failures"
+[ $failed = 0 ]
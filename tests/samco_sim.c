@@ -0,0 +1,204 @@
+/*
+ * File name: samco_sim.c
+ * Description: Runs a .samco program for the tests and prints every var
+ *              from the .temp symbol table the way --run does.
+ *
+ * Notes:
+ *      ./samco_sim <program.samco> <.temp> [max_steps]
+ *
+ *      The program is loaded at addr 0, so tests use PROG_MEMORY_START 0.
+ *      Program and data memory are kept apart. The run stops when the
+ *      program counter leaves the program or after max_steps, which is
+ *      how a program ending in the cold body spin is stopped.
+ *
+ *      lshf R imm   R = (R << 8 | imm) & 0xFFFF
+ *      GET A B      A = mem[B]
+ *      PUT A B      mem[B] = A
+ *      add/sub/mul/div A B  A = A <op> B, zero flag set when A is 0,
+ *                   dividing by 0 gives 0
+ *      jz R         go to R when the zero flag is set
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <ctype.h>
+
+#define MAX_LINE_SIZE_CHAR      1024
+#define MAX_PROGRAM_SIZE        65536
+#define DEFAULT_MAX_STEPS       10000000L
+
+enum SIM_OPCODES
+{
+    SIM_LSHF,
+    SIM_GET,
+    SIM_PUT,
+    SIM_ADD,
+    SIM_SUB,
+    SIM_MUL,
+    SIM_DIV,
+    SIM_JZ
+};
+
+struct sim_instruction
+{
+    enum SIM_OPCODES opcode;
+    int a;                  //register number, DR is 0
+    int b;                  //register number or the lshf byte
+};
+
+static struct sim_instruction program[MAX_PROGRAM_SIZE];
+static int program_size = 0;
+static uint16_t memory[65536];
+
+static void
+sim_error(const char *message, const char *detail)
+{
+    fprintf(stderr, "samco_sim: %s %s\n", message, detail);
+    exit(2);
+}
+
+static int
+register_number(const char *reg)
+{
+    if(strcasecmp(reg, "DR") == 0) return 0;
+    if((reg[0] == 'r' || reg[0] == 'R') && reg[1] >= '1' && reg[1] <= '7' && reg[2] == '\0')
+    {
+        return reg[1] - '0';
+    }
+    sim_error("Bad register", reg);
+    return -1;
+}
+
+static void
+load_program(const char *filename)
+{
+    static const char *names[] = {"lshf", "get", "put", "add", "sub", "mul", "div", "jz"};
+    char line[MAX_LINE_SIZE_CHAR];
+    char opcode[16];
+    char first[16];
+    char second[16];
+
+    FILE *fd = fopen(filename, "r");
+    if(fd == NULL) sim_error("Failed to open", filename);
+    while(fgets(line, sizeof(line), fd) != NULL)
+    {
+        for(char *c = line; *c != '\0'; c++) if(*c == ',') *c = ' ';
+        int count = sscanf(line, "%15s %15s %15s", opcode, first, second);
+        if(count < 1 || strncmp(opcode, "//", 2) == 0) continue;
+        if(program_size >= MAX_PROGRAM_SIZE) sim_error("Program too big", filename);
+
+        struct sim_instruction *instruction = &program[program_size++];
+        int found = 0;
+        for(int i = 0; i <= SIM_JZ; i++)
+        {
+            if(strcasecmp(opcode, names[i]) == 0)
+            {
+                instruction->opcode = i;
+                found = 1;
+            }
+        }
+        if(!found || count < 2) sim_error("Bad instruction", line);
+        instruction->a = register_number(first);
+        if(instruction->opcode == SIM_JZ) continue;
+        if(count < 3) sim_error("Bad instruction", line);
+        if(instruction->opcode == SIM_LSHF) instruction->b = strtol(second, NULL, 16) & 0xFF;
+        else instruction->b = register_number(second);
+    }
+    fclose(fd);
+}
+
+static long
+run(long max_steps)
+{
+    uint16_t registers[8] = {0};
+    int zero = 0;
+    int pc = 0;
+    long steps = 0;
+
+    while(pc >= 0 && pc < program_size && steps < max_steps)
+    {
+        struct sim_instruction *instruction = &program[pc++];
+        uint16_t *a = &registers[instruction->a];
+        uint16_t b = registers[instruction->b];
+        steps++;
+
+        switch(instruction->opcode)
+        {
+            case SIM_LSHF:  *a = (uint16_t)((*a << 8) | instruction->b); break;
+            case SIM_GET:   *a = memory[b]; break;
+            case SIM_PUT:   memory[b] = *a; break;
+            case SIM_ADD:   *a = (uint16_t)(*a + b); zero = (*a == 0); break;
+            case SIM_SUB:   *a = (uint16_t)(*a - b); zero = (*a == 0); break;
+            case SIM_MUL:   *a = (uint16_t)((uint32_t)*a * b); zero = (*a == 0); break;
+            case SIM_DIV:   *a = b ? *a / b : 0; zero = (*a == 0); break;
+            case SIM_JZ:    if(zero) pc = *a; break;
+        }
+    }
+    return steps;
+}
+
+/**
+ * @brief Prints vars and arrays from .temp once each, skipping return
+ *        slots and other names that start with .
+ *
+ */
+static void
+print_vars(const char *symbols_filename)
+{
+    char line[MAX_LINE_SIZE_CHAR];
+    char name[MAX_LINE_SIZE_CHAR];
+    char **printed = NULL;
+    int printed_count = 0;
+    int addr;
+    int value;
+    int length;
+
+    FILE *fd = fopen(symbols_filename, "r");
+    if(fd == NULL) sim_error("Failed to open", symbols_filename);
+    while(fgets(line, sizeof(line), fd) != NULL)
+    {
+        int count = sscanf(line, "%d %1023s %d %d", &addr, name, &value, &length);
+        if(count < 2 || addr < 0 || name[0] == '.' || strchr(name, '[') != NULL) continue;
+
+        int seen = 0;
+        for(int i = 0; i < printed_count; i++) if(strcmp(printed[i], name) == 0) seen = 1;
+        if(seen) continue;
+        printed = realloc(printed, (printed_count + 1) * sizeof(*printed));
+        if(printed == NULL) sim_error("Out of memory", "");
+        printed[printed_count++] = strdup(name);
+
+        if(count < 4)
+        {
+            printf("%s = %u\n", name, memory[addr & 0xFFFF]);
+            continue;
+        }
+        printf("%s =", name);
+        for(int i = 0; i < length; i++) printf(" %u", memory[(addr + i) & 0xFFFF]);
+        printf("\n");
+    }
+    fclose(fd);
+    for(int i = 0; i < printed_count; i++) free(printed[i]);
+    free(printed);
+}
+
+int
+main(int argc, char **argv)
+{
+    if(argc != 3 && argc != 4)
+    {
+        fprintf(stderr, "./samco_sim <program.samco> <.temp> [max_steps]\n");
+        return 2;
+    }
+    long max_steps = (argc == 4) ? atol(argv[3]) : DEFAULT_MAX_STEPS;
+
+    load_program(argv[1]);
+    long steps = run(max_steps);
+    print_vars(argv[2]);
+    fprintf(stderr, "%ld steps\n", steps);
+    return 0;
+}
+
+/* End of file: samco_sim.c */